@@ -0,0 +1,182 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* BenchmarkHarness.h
+* Shared timing, percentile and process memory helpers for the MarbleBag benchmarks.
+*
+* Usage:
+*	crux::bench::Stopwatch watch;											// Starts timing on construction
+*	double seconds = watch.ElapsedSeconds();								// Seconds since construction or last Restart()
+*	double p99 = crux::bench::Percentile( tickTimes, 0.99 );				// Nearest-rank percentile, sorts the samples in place
+*	crux::bench::PrintRow( row );											// Prints one result row, including per-draw hardware counters when available
+*
+*/
+
+#pragma once
+
+#include "PerfCounters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined( __linux__ )
+#include <sys/resource.h>
+#endif
+
+namespace crux
+{
+namespace bench
+{
+/// Monotonic wall clock timer.
+class Stopwatch
+{
+public:
+
+	/// Constructor, starts timing
+	Stopwatch() : m_start( std::chrono::steady_clock::now() ) {}
+
+	/// Restarts timing from now.
+	void Restart() { m_start = std::chrono::steady_clock::now(); }
+
+	/// Returns seconds elapsed since construction or last Restart().
+	double ElapsedSeconds() const
+	{
+		return std::chrono::duration< double >( std::chrono::steady_clock::now() - m_start ).count();
+	}
+
+private:
+
+	std::chrono::steady_clock::time_point m_start;
+};
+
+/// One result line of a benchmark run.
+struct BenchmarkRow
+{
+	std::string name;
+	std::uint64_t numDraws = { 0 };
+	double seconds = { 0.0 };
+	double p50TickMs = { 0.0 };
+	double p99TickMs = { 0.0 };
+	std::uint64_t rssKiB = { 0 };
+	PerfCounterValues counters;
+};
+
+/// Returns nearest-rank percentile of samples in [0, 1]. Sorts samples in place. Returns 0 if empty.
+inline double Percentile( std::vector< double >& samples, double fraction )
+{
+	if( samples.empty() )
+	{
+		return 0.0;
+	}
+	std::sort( samples.begin(), samples.end() );
+	std::size_t rank = static_cast< std::size_t >( fraction * static_cast< double >( samples.size() - 1 ) + 0.5 );
+	return samples[ std::min( rank, samples.size() - 1 ) ];
+}
+
+/// Returns current resident set size in KiB. Falls back to peak RSS, then 0 where unsupported.
+inline std::uint64_t GetResidentSetKiB()
+{
+#if defined( __linux__ )
+	if( std::FILE* status = std::fopen( "/proc/self/status", "r" ) )
+	{
+		char line[ 256 ];
+		std::uint64_t rssKiB = 0;
+		while( std::fgets( line, sizeof( line ), status ) )
+		{
+			if( std::strncmp( line, "VmRSS:", 6 ) == 0 )
+			{
+				rssKiB = std::strtoull( line + 6, nullptr, 10 );
+				break;
+			}
+		}
+		std::fclose( status );
+		if( rssKiB != 0 )
+		{
+			return rssKiB;
+		}
+	}
+	rusage usage;
+	if( getrusage( RUSAGE_SELF, &usage ) == 0 )
+	{
+		return static_cast< std::uint64_t >( usage.ru_maxrss );
+	}
+#endif
+	return 0;
+}
+
+/// Prints column header matching PrintRow().
+inline void PrintHeader()
+{
+	std::printf( "%-32s %14s %14s %10s %10s %10s %10s %10s %6s %10s %10s %10s\n",
+		"benchmark", "draws", "draws/sec", "p50 ms", "p99 ms", "RSS KiB",
+		"cyc/draw", "ins/draw", "IPC", "brmis/draw", "L1Dmis/drw", "LLCmis/drw" );
+}
+
+/// Prints counter total divided by draws, or n/a if the counter was unavailable.
+inline void PrintPerDraw( const PerfCounterValues& counters, PerfCounterId id, std::uint64_t numDraws )
+{
+	if( counters.IsValid( id ) && numDraws > 0 )
+	{
+		std::printf( " %10.2f", static_cast< double >( counters.Get( id ) ) / static_cast< double >( numDraws ) );
+	}
+	else
+	{
+		std::printf( " %10s", "n/a" );
+	}
+}
+
+/// Prints one result row.
+inline void PrintRow( const BenchmarkRow& row )
+{
+	double drawsPerSec = row.seconds > 0.0 ? static_cast< double >( row.numDraws ) / row.seconds : 0.0;
+	std::printf( "%-32s %14llu %14.0f %10.3f %10.3f %10llu",
+		row.name.c_str(),
+		static_cast< unsigned long long >( row.numDraws ),
+		drawsPerSec,
+		row.p50TickMs,
+		row.p99TickMs,
+		static_cast< unsigned long long >( row.rssKiB ) );
+
+	const PerfCounterValues& counters = row.counters;
+	PrintPerDraw( counters, PerfCounterId::Cycles, row.numDraws );
+	PrintPerDraw( counters, PerfCounterId::Instructions, row.numDraws );
+	if( counters.IsValid( PerfCounterId::Cycles ) && counters.IsValid( PerfCounterId::Instructions ) && counters.Get( PerfCounterId::Cycles ) > 0 )
+	{
+		std::printf( " %6.2f", static_cast< double >( counters.Get( PerfCounterId::Instructions ) ) / static_cast< double >( counters.Get( PerfCounterId::Cycles ) ) );
+	}
+	else
+	{
+		std::printf( " %6s", "n/a" );
+	}
+	PrintPerDraw( counters, PerfCounterId::BranchMisses, row.numDraws );
+	PrintPerDraw( counters, PerfCounterId::L1DMisses, row.numDraws );
+	PrintPerDraw( counters, PerfCounterId::LLCMisses, row.numDraws );
+	std::printf( "\n" );
+}
+
+}
+}
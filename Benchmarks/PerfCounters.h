@@ -0,0 +1,230 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* PerfCounters.h
+* Hardware performance counters for the MarbleBag benchmarks via Linux perf_event_open.
+* Each counter is opened independently so a missing event (VMs, containers, restrictive
+* perf_event_paranoid, non-Linux builds) only disables that column instead of the whole set.
+* Values are scaled for multiplexing using time enabled / time running.
+*
+* Usage:
+*	crux::bench::PerfCounters counters;										// Opens whatever counters the host allows
+*	counters.Start();														// Resets and enables all open counters
+*	...
+*	crux::bench::PerfCounterValues values = counters.Stop();				// Disables counters and returns scaled totals
+*	if( values.IsValid( crux::bench::PerfCounterId::Cycles ) ) { ... }		// Test availability per counter
+*
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace crux
+{
+namespace bench
+{
+/// Counters reported per benchmark row.
+enum class PerfCounterId : int
+{
+	Cycles,
+	Instructions,
+	BranchMisses,
+	L1DMisses,
+	LLCMisses,
+	Count
+};
+
+/// Totals collected between PerfCounters::Start() and PerfCounters::Stop().
+struct PerfCounterValues
+{
+	std::uint64_t values[ static_cast< int >( PerfCounterId::Count ) ] = {};
+	bool valid[ static_cast< int >( PerfCounterId::Count ) ] = {};
+
+	/// Returns if counter was available for the measured interval.
+	bool IsValid( PerfCounterId id ) const { return valid[ static_cast< int >( id ) ]; }
+
+	/// Returns counter total. Only meaningful if IsValid( id ).
+	std::uint64_t Get( PerfCounterId id ) const { return values[ static_cast< int >( id ) ]; }
+};
+
+/// Owns one perf event file descriptor per PerfCounterId for the calling thread.
+class PerfCounters
+{
+public:
+
+	/// Constructor, opens all counters the host allows
+	PerfCounters();
+
+	/// Destructor, closes counters
+	~PerfCounters();
+
+	/// No copy operations
+	PerfCounters( const PerfCounters& other ) = delete;
+	PerfCounters& operator=( const PerfCounters& other ) = delete;
+
+	/// Returns if at least one counter opened.
+	bool IsAvailable() const;
+
+	/// Resets and enables all open counters.
+	void Start();
+
+	/// Disables all open counters and returns scaled totals.
+	PerfCounterValues Stop();
+
+private:
+
+	int m_fds[ static_cast< int >( PerfCounterId::Count ) ];
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+#if defined( __linux__ )
+
+inline PerfCounters::PerfCounters()
+{
+	const std::uint32_t types[] =
+	{
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HW_CACHE,
+		PERF_TYPE_HARDWARE,
+	};
+	const std::uint64_t configs[] =
+	{
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ),
+		PERF_COUNT_HW_CACHE_MISSES,
+	};
+	for( int i = 0; i < static_cast< int >( PerfCounterId::Count ); ++i )
+	{
+		perf_event_attr attr;
+		std::memset( &attr, 0, sizeof( attr ) );
+		attr.size = sizeof( attr );
+		attr.type = types[ i ];
+		attr.config = configs[ i ];
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		m_fds[ i ] = static_cast< int >( syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+	}
+}
+
+inline PerfCounters::~PerfCounters()
+{
+	for( int fd : m_fds )
+	{
+		if( fd >= 0 )
+		{
+			close( fd );
+		}
+	}
+}
+
+inline bool PerfCounters::IsAvailable() const
+{
+	for( int fd : m_fds )
+	{
+		if( fd >= 0 )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void PerfCounters::Start()
+{
+	for( int fd : m_fds )
+	{
+		if( fd >= 0 )
+		{
+			ioctl( fd, PERF_EVENT_IOC_RESET, 0 );
+			ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+		}
+	}
+}
+
+inline PerfCounterValues PerfCounters::Stop()
+{
+	PerfCounterValues result;
+	for( int i = 0; i < static_cast< int >( PerfCounterId::Count ); ++i )
+	{
+		if( m_fds[ i ] < 0 )
+		{
+			continue;
+		}
+		ioctl( m_fds[ i ], PERF_EVENT_IOC_DISABLE, 0 );
+		std::uint64_t data[ 3 ] = {};	// value, time enabled, time running
+		if( read( m_fds[ i ], data, sizeof( data ) ) != static_cast< ssize_t >( sizeof( data ) ) || data[ 2 ] == 0 )
+		{
+			continue;
+		}
+		double scale = static_cast< double >( data[ 1 ] ) / static_cast< double >( data[ 2 ] );
+		result.values[ i ] = static_cast< std::uint64_t >( static_cast< double >( data[ 0 ] ) * scale );
+		result.valid[ i ] = true;
+	}
+	return result;
+}
+
+#else
+
+inline PerfCounters::PerfCounters()
+{
+	for( int& fd : m_fds )
+	{
+		fd = -1;
+	}
+}
+
+inline PerfCounters::~PerfCounters() = default;
+
+inline bool PerfCounters::IsAvailable() const
+{
+	return false;
+}
+
+inline void PerfCounters::Start()
+{}
+
+inline PerfCounterValues PerfCounters::Stop()
+{
+	return PerfCounterValues{};
+}
+
+#endif
+
+}
+}
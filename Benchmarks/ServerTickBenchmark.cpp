@@ -0,0 +1,344 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* ServerTickBenchmark.cpp
+* End-to-end benchmark modelling a game server tick driving many MarbleBags.
+*
+* Each tick despawns and spawns entities, draws from per-entity bags with a power-law
+* access skew (few hot entities, many cold ones), resets non-auto-reset bags at cycle end
+* and periodically writes a checkpoint of every live bag. Bag sizes are mixed per scenario.
+* Reports draws/sec, p50/p99 tick time and resident set size per scenario, plus per-draw
+* hardware counters (cycles, instructions, IPC, branch/L1D/LLC misses) where perf events are permitted.
+* Counters cover the whole tick loop, including churn and checkpoints.
+*
+* Build:
+*	g++ -O2 -std=c++14 -I.. ServerTickBenchmark.cpp -o ServerTickBenchmark
+*
+* Usage:
+*	ServerTickBenchmark [--entities N] [--ticks N] [--draws N] [--seed N]
+*
+*/
+
+#include "../MarbleBag.h"
+#include "BenchmarkHarness.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+/// Bag sizes exercised by the benchmark, indexed by size class.
+enum SizeClass : std::uint8_t
+{
+	Size4,
+	Size10,
+	Size32,
+	Size100,
+	Size1000,
+	NumSizeClasses
+};
+
+/// Workload description for one benchmark row.
+struct Scenario
+{
+	const char* name;
+	int sizeClassWeights[ NumSizeClasses ];
+	double accessSkew;		// Exponent applied to a uniform variate to pick the accessed entity. 1 is uniform, higher is hotter.
+	double autoResetFraction;	// Fraction of spawned bags with bAutoReset enabled
+};
+
+struct Config
+{
+	int numEntities = { 200000 };
+	int numTicks = { 600 };
+	int drawsPerTick = { 20000 };
+	int churnPerTick = { 200 };
+	int checkpointInterval = { 100 };
+	std::uint32_t seed = { 2017 };
+};
+
+struct Entity
+{
+	std::uint32_t id;
+	SizeClass sizeClass;
+	int slot;
+};
+
+/// Fixed capacity storage for bags of one size. Slots are recycled, bags are never moved.
+template< int NumMarbles >
+class BagPool
+{
+public:
+
+	explicit BagPool( int capacity ) { m_bags.reserve( capacity ); }
+
+	int Acquire( std::uint32_t seed, bool bAutoReset )
+	{
+		int slot;
+		if( !m_freeSlots.empty() )
+		{
+			slot = m_freeSlots.back();
+			m_freeSlots.pop_back();
+			m_bags[ slot ].Reset();
+			m_bags[ slot ].SetRandomEngine( std::default_random_engine{ seed } );
+		}
+		else
+		{
+			slot = static_cast< int >( m_bags.size() );
+			m_bags.emplace_back( std::default_random_engine{ seed } );
+		}
+		m_bags[ slot ].bAutoReset = bAutoReset;
+		return slot;
+	}
+
+	void Release( int slot ) { m_freeSlots.push_back( slot ); }
+
+	crux::MarbleBag< NumMarbles >& operator[]( int slot ) { return m_bags[ slot ]; }
+
+private:
+
+	std::vector< crux::MarbleBag< NumMarbles > > m_bags;
+	std::vector< int > m_freeSlots;
+};
+
+class World
+{
+public:
+
+	World( const Config& config, const Scenario& scenario )
+		: m_scenario( scenario )
+		, m_random( config.seed )
+		, m_pool4( config.numEntities + config.churnPerTick )
+		, m_pool10( config.numEntities + config.churnPerTick )
+		, m_pool32( config.numEntities + config.churnPerTick )
+		, m_pool100( config.numEntities + config.churnPerTick )
+		, m_pool1000( config.numEntities + config.churnPerTick )
+		, m_sizeClassPicker( std::begin( scenario.sizeClassWeights ), std::end( scenario.sizeClassWeights ) )
+	{
+		m_entities.reserve( config.numEntities + config.churnPerTick );
+		for( int i = 0; i < config.numEntities; ++i )
+		{
+			Spawn();
+		}
+	}
+
+	void Spawn()
+	{
+		Entity entity;
+		entity.id = m_nextId++;
+		entity.sizeClass = static_cast< SizeClass >( m_sizeClassPicker( m_random ) );
+		std::uint32_t seed = static_cast< std::uint32_t >( m_random() );
+		bool bAutoReset = m_unit( m_random ) < m_scenario.autoResetFraction;
+		switch( entity.sizeClass )
+		{
+		case Size4:		entity.slot = m_pool4.Acquire( seed, bAutoReset ); break;
+		case Size10:	entity.slot = m_pool10.Acquire( seed, bAutoReset ); break;
+		case Size32:	entity.slot = m_pool32.Acquire( seed, bAutoReset ); break;
+		case Size100:	entity.slot = m_pool100.Acquire( seed, bAutoReset ); break;
+		default:		entity.slot = m_pool1000.Acquire( seed, bAutoReset ); break;
+		}
+		m_entities.push_back( entity );
+	}
+
+	void DespawnRandom()
+	{
+		if( m_entities.empty() )
+		{
+			return;
+		}
+		std::size_t index = static_cast< std::size_t >( m_unit( m_random ) * m_entities.size() );
+		Entity& entity = m_entities[ index ];
+		switch( entity.sizeClass )
+		{
+		case Size4:		m_pool4.Release( entity.slot ); break;
+		case Size10:	m_pool10.Release( entity.slot ); break;
+		case Size32:	m_pool32.Release( entity.slot ); break;
+		case Size100:	m_pool100.Release( entity.slot ); break;
+		default:		m_pool1000.Release( entity.slot ); break;
+		}
+		entity = m_entities.back();
+		m_entities.pop_back();
+	}
+
+	/// Draws once from a skew-selected entity. Returns the drawn value.
+	int DrawSkewed()
+	{
+		double u = std::pow( m_unit( m_random ), m_scenario.accessSkew );
+		const Entity& entity = m_entities[ static_cast< std::size_t >( u * m_entities.size() ) ];
+		switch( entity.sizeClass )
+		{
+		case Size4:		return Draw( m_pool4[ entity.slot ] );
+		case Size10:	return Draw( m_pool10[ entity.slot ] );
+		case Size32:	return Draw( m_pool32[ entity.slot ] );
+		case Size100:	return Draw( m_pool100[ entity.slot ] );
+		default:		return Draw( m_pool1000[ entity.slot ] );
+		}
+	}
+
+	/// Serializes id, size class and remaining count of every live bag.
+	void Checkpoint( std::vector< std::uint8_t >& buffer )
+	{
+		buffer.clear();
+		for( const Entity& entity : m_entities )
+		{
+			int remaining;
+			switch( entity.sizeClass )
+			{
+			case Size4:		remaining = m_pool4[ entity.slot ].GetRemainingCount(); break;
+			case Size10:	remaining = m_pool10[ entity.slot ].GetRemainingCount(); break;
+			case Size32:	remaining = m_pool32[ entity.slot ].GetRemainingCount(); break;
+			case Size100:	remaining = m_pool100[ entity.slot ].GetRemainingCount(); break;
+			default:		remaining = m_pool1000[ entity.slot ].GetRemainingCount(); break;
+			}
+			const std::uint8_t* idBytes = reinterpret_cast< const std::uint8_t* >( &entity.id );
+			buffer.insert( buffer.end(), idBytes, idBytes + sizeof( entity.id ) );
+			buffer.push_back( entity.sizeClass );
+			buffer.push_back( static_cast< std::uint8_t >( remaining & 0xff ) );
+			buffer.push_back( static_cast< std::uint8_t >( remaining >> 8 ) );
+		}
+	}
+
+private:
+
+	template< int NumMarbles >
+	static int Draw( crux::MarbleBag< NumMarbles >& bag )
+	{
+		int value = bag.GetNext();
+		if( !bag.bAutoReset && !bag.HasMarbles() )
+		{
+			bag.Reset();
+		}
+		return value;
+	}
+
+private:
+
+	const Scenario& m_scenario;
+	std::mt19937 m_random;
+	std::uniform_real_distribution< double > m_unit;
+	BagPool< 4 > m_pool4;
+	BagPool< 10 > m_pool10;
+	BagPool< 32 > m_pool32;
+	BagPool< 100 > m_pool100;
+	BagPool< 1000 > m_pool1000;
+	std::discrete_distribution< int > m_sizeClassPicker;
+	std::vector< Entity > m_entities;
+	std::uint32_t m_nextId = { 0 };
+};
+
+crux::bench::BenchmarkRow RunScenario( const Config& config, const Scenario& scenario, std::uint64_t& checksum )
+{
+	World world( config, scenario );
+	std::vector< std::uint8_t > checkpointBuffer;
+	std::vector< double > tickMs;
+	tickMs.reserve( config.numTicks );
+
+	crux::bench::PerfCounters counters;
+	crux::bench::Stopwatch total;
+	crux::bench::Stopwatch tick;
+	counters.Start();
+	for( int tickIndex = 1; tickIndex <= config.numTicks; ++tickIndex )
+	{
+		tick.Restart();
+		for( int i = 0; i < config.churnPerTick; ++i )
+		{
+			world.DespawnRandom();
+			world.Spawn();
+		}
+		for( int i = 0; i < config.drawsPerTick; ++i )
+		{
+			checksum += static_cast< std::uint64_t >( world.DrawSkewed() );
+		}
+		if( config.checkpointInterval > 0 && tickIndex % config.checkpointInterval == 0 )
+		{
+			world.Checkpoint( checkpointBuffer );
+			checksum += checkpointBuffer.size();
+		}
+		tickMs.push_back( tick.ElapsedSeconds() * 1000.0 );
+	}
+
+	crux::bench::BenchmarkRow row;
+	row.counters = counters.Stop();
+	row.name = scenario.name;
+	row.seconds = total.ElapsedSeconds();
+	row.numDraws = static_cast< std::uint64_t >( config.numTicks ) * config.drawsPerTick;
+	row.rssKiB = crux::bench::GetResidentSetKiB();
+	row.p50TickMs = crux::bench::Percentile( tickMs, 0.50 );
+	row.p99TickMs = crux::bench::Percentile( tickMs, 0.99 );
+	return row;
+}
+
+bool ParseArgs( int argc, char** argv, Config& config )
+{
+	for( int i = 1; i < argc; ++i )
+	{
+		if( i + 1 >= argc )
+		{
+			return false;
+		}
+		long value = std::strtol( argv[ i + 1 ], nullptr, 10 );
+		if( std::strcmp( argv[ i ], "--entities" ) == 0 )		{ config.numEntities = static_cast< int >( value ); }
+		else if( std::strcmp( argv[ i ], "--ticks" ) == 0 )		{ config.numTicks = static_cast< int >( value ); }
+		else if( std::strcmp( argv[ i ], "--draws" ) == 0 )		{ config.drawsPerTick = static_cast< int >( value ); }
+		else if( std::strcmp( argv[ i ], "--seed" ) == 0 )		{ config.seed = static_cast< std::uint32_t >( value ); }
+		else
+		{
+			return false;
+		}
+		++i;
+	}
+	return config.numEntities > 0 && config.numTicks > 0 && config.drawsPerTick >= 0;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+	Config config;
+	if( !ParseArgs( argc, argv, config ) )
+	{
+		std::fprintf( stderr, "Usage: %s [--entities N] [--ticks N] [--draws N] [--seed N]\n", argv[ 0 ] );
+		return 1;
+	}
+
+	//								  N=4  N=10 N=32 N=100 N=1000	skew	auto
+	const Scenario scenarios[] =
+	{
+		{ "server_tick/mixed",			{ 30,  30,  20,  15,   5 },		3.0,	0.5 },
+		{ "server_tick/small_bag_burst",	{ 70,  30,   0,   0,   0 },		3.0,	1.0 },
+		{ "server_tick/large_cold",		{  0,   0,  10,  50,  40 },		6.0,	0.0 },
+	};
+
+	std::uint64_t checksum = 0;
+	crux::bench::PrintHeader();
+	for( const Scenario& scenario : scenarios )
+	{
+		crux::bench::PrintRow( RunScenario( config, scenario, checksum ) );
+	}
+	std::printf( "checksum %llu\n", static_cast< unsigned long long >( checksum ) );
+	return 0;
+}
@@ -0,0 +1,225 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* BernoulliBag.h
+* Dependent probability for a yes/no event with rate NumSuccesses / NumMarbles.
+* Every cycle of NumMarbles draws returns exactly NumSuccesses successes, same as a MarbleBag< NumMarbles >
+* tested against value < NumSuccesses, but the state is only the successes and draws remaining in the cycle.
+* A draw is one bounded roll compared against the successes remaining.
+* Move constructor and move assignment only, no copy.
+*
+* Usage:
+*	BernoulliBag< 17, 100 > critBag;														// 17 crits in every 100 draws, chrono-based seed
+*	BernoulliBag< 17, 100 > critBag( std::move( std::default_random_engine{ 2017 } ) );	// Constructed with explicit seed
+*	bool bCrit = critBag.GetNext();														// Next outcome
+*	std::uint64_t crits = critBag.GetNext64();												// Bit i holds outcome of draw i of the next 64
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+namespace crux
+{
+/// Utility for dependent probability of a boolean event.
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType = std::default_random_engine >
+class BernoulliBag
+{
+	static_assert( NumMarbles > 0, "BernoulliBag needs at least one marble" );
+	static_assert( NumSuccesses >= 0 && NumSuccesses <= NumMarbles, "BernoulliBag successes must be within [0, NumMarbles]" );
+
+public:
+
+	/// Default Constructor
+	BernoulliBag();
+
+	/// Constructor with move of random engine type
+	BernoulliBag( RandomEngineType&& randomEngine );
+
+	/// Destructor
+	~BernoulliBag() = default;
+
+	/// No copy operations
+	BernoulliBag( const BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >& other ) = delete;
+	BernoulliBag& operator=( const BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >& other ) = delete;
+
+	/// Move operations
+	BernoulliBag( BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >&& other ) = default;
+	BernoulliBag& operator=( BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >&& other ) = default;
+
+	/// Returns next outcome. Returns false if no marbles remain, check HasMarbles() when bAutoReset is off.
+	bool GetNext();
+
+	/// Returns outcomes of the next 64 draws, draw i in bit i. outNumDrawn receives draws taken, less than 64 only if marbles ran out without bAutoReset.
+	std::uint64_t GetNext64( int* outNumDrawn = nullptr );
+
+	/// Returns quantity of draws left in the current cycle.
+	const int GetRemainingCount() const;
+
+	/// Returns quantity of successes left in the current cycle.
+	const int GetRemainingSuccesses() const;
+
+	/// Returns if any draws remain.
+	bool HasMarbles() const;
+
+	/// Returns all marbles to bag.
+	void Reset();
+
+	/// Explicitly set random engine.
+	void SetRandomEngine( RandomEngineType&& randomEngine );
+
+private:
+
+	bool Draw();
+
+private:
+
+	RandomEngineType m_randomEngine;
+	int m_remainingSuccesses = { NumSuccesses };
+	int m_remainingDraws = { NumMarbles };
+
+public:
+
+	/// If true, auto reset marble bag when empty
+	bool bAutoReset = { true };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+void BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::SetRandomEngine( RandomEngineType&& randomEngine )
+{
+	m_randomEngine = std::forward< RandomEngineType >( randomEngine );
+}
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+void BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::Reset()
+{
+	m_remainingSuccesses = NumSuccesses;
+	m_remainingDraws = NumMarbles;
+}
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+bool BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::HasMarbles() const
+{
+	return m_remainingDraws > 0;
+}
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+const int BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::GetRemainingSuccesses() const
+{
+	return m_remainingSuccesses;
+}
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+const int BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::GetRemainingCount() const
+{
+	return m_remainingDraws;
+}
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+bool BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::GetNext()
+{
+	if( !HasMarbles() )
+	{
+		if( !bAutoReset )
+		{
+			return false;
+		}
+		Reset();
+	}
+	return Draw();
+}
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+std::uint64_t BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::GetNext64( int* outNumDrawn )
+{
+	std::uint64_t outcomes = 0;
+	int numDrawn = 0;
+	while( numDrawn < 64 )
+	{
+		if( !HasMarbles() )
+		{
+			if( !bAutoReset )
+			{
+				break;
+			}
+			Reset();
+		}
+		if( m_remainingSuccesses == 0 || m_remainingSuccesses == m_remainingDraws )
+		{
+			// Rest of the cycle is decided, emit it as one run without rolling.
+			int runLength = std::min( 64 - numDrawn, m_remainingDraws );
+			if( m_remainingSuccesses > 0 )
+			{
+				std::uint64_t run = runLength == 64 ? ~std::uint64_t( 0 ) : ( std::uint64_t( 1 ) << runLength ) - 1;
+				outcomes |= run << numDrawn;
+				m_remainingSuccesses -= runLength;
+			}
+			m_remainingDraws -= runLength;
+			numDrawn += runLength;
+			continue;
+		}
+		outcomes |= std::uint64_t( Draw() ) << numDrawn;
+		++numDrawn;
+	}
+	if( outNumDrawn != nullptr )
+	{
+		*outNumDrawn = numDrawn;
+	}
+	return outcomes;
+}
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::BernoulliBag( RandomEngineType&& randomEngine )
+	: m_randomEngine( std::forward< RandomEngineType >( randomEngine ) )
+{}
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::BernoulliBag()
+	: BernoulliBag( std::move( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
+{}
+
+//
+// Private
+//
+
+template< int NumSuccesses, int NumMarbles, typename RandomEngineType >
+bool BernoulliBag< NumSuccesses, NumMarbles, RandomEngineType >::Draw()
+{
+	std::uniform_int_distribution< int > distribution( 0, m_remainingDraws - 1 );
+	bool bSuccess = distribution( m_randomEngine ) < m_remainingSuccesses;
+	m_remainingSuccesses -= bSuccess ? 1 : 0;
+	--m_remainingDraws;
+	return bSuccess;
+}
+
+}
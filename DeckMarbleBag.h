@@ -0,0 +1,342 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* DeckMarbleBag.h
+* Card deck with draw pile, discard pile, hand and in-play cards for card values [0, numCards).
+* All piles are consecutive ranges of one card array, laid out as draw | discard | hand | in play, with a
+* position array from card value to slot. Moving a card swaps it to the edge of its pile and shifts the
+* boundary, once per pile crossed, so draw, play and discard are O(1). The draw pile is not kept in order:
+* a draw picks a random card from it, which makes adding cards to it a reshuffle. Returning the discard
+* pile to the draw pile is a boundary move, so reshuffling costs O(1) instead of touching every card.
+* Move constructor and move assignment only, no copy.
+*
+* Usage:
+*	DeckMarbleBag<> deck( 52 );															// Cards [0, 51] in the draw pile, chrono-based seed
+*	DeckMarbleBag<> deck( 52, std::move( std::default_random_engine{ 2017 } ) );		// Constructed with explicit seed
+*	int card = deck.Draw();																// Random draw pile card to hand, reshuffles the discard pile first if the draw pile is empty
+*	deck.Play( card ); deck.Discard( otherCard );										// Hand to in play, hand or in play to discard
+*	deck.DiscardHand(); deck.DiscardInPlay();											// End of turn
+*	const int* hand = deck.GetPile( DeckPile::Hand ); int handSize = deck.GetPileSize( DeckPile::Hand );
+*
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace crux
+{
+/// Piles of a DeckMarbleBag, in the order they are laid out.
+enum class DeckPile : std::uint8_t
+{
+	Draw,		///< Cards still to be drawn, drawn in random order
+	Discard,	///< Cards returned to the draw pile by the next reshuffle
+	Hand,		///< Drawn cards
+	InPlay		///< Played cards waiting to be discarded
+};
+
+/// Utility for a card deck with draw and discard piles.
+template< typename RandomEngineType = std::default_random_engine >
+class DeckMarbleBag
+{
+public:
+
+	/// Constructor with chrono-based seed
+	explicit DeckMarbleBag( int numCards );
+
+	/// Constructor with move of random engine type
+	DeckMarbleBag( int numCards, RandomEngineType&& randomEngine );
+
+	/// Destructor
+	~DeckMarbleBag() = default;
+
+	/// No copy operations
+	DeckMarbleBag( const DeckMarbleBag< RandomEngineType >& other ) = delete;
+	DeckMarbleBag& operator=( const DeckMarbleBag< RandomEngineType >& other ) = delete;
+
+	/// Move operations
+	DeckMarbleBag( DeckMarbleBag< RandomEngineType >&& other ) = default;
+	DeckMarbleBag& operator=( DeckMarbleBag< RandomEngineType >&& other ) = default;
+
+	/// Moves a random draw pile card to the hand and returns it. An empty draw pile is refilled from the discard pile
+	/// if bAutoReshuffle is set. Returns -1 if no card can be drawn.
+	int Draw();
+
+	/// Draws up to count cards into outCards. Returns number drawn, less than count only if no card can be drawn.
+	int Draw( int* outCards, int count );
+
+	/// Moves a card from the hand to in play. Returns false if card is not in the hand.
+	bool Play( int card );
+
+	/// Moves a card from the hand or in play to the discard pile. Returns false if card is in neither.
+	bool Discard( int card );
+
+	/// Moves the whole hand to the discard pile in O(1).
+	void DiscardHand();
+
+	/// Moves all in play cards to the discard pile, O(1) per card.
+	void DiscardInPlay();
+
+	/// Moves the discard pile into the draw pile in O(1). Drawing picks randomly, so this reshuffles them.
+	void ReshuffleDiscard();
+
+	/// Moves a card to any pile in O(1). Returns false if card is out of range.
+	bool MoveCard( int card, DeckPile pile );
+
+	/// Returns pile holding card, card must be in range.
+	DeckPile FindPile( int card ) const;
+
+	/// Returns cards of pile, GetPileSize( pile ) of them in no particular order. Any change to the deck invalidates the pointer.
+	const int* GetPile( DeckPile pile ) const;
+
+	/// Returns quantity of cards in pile.
+	int GetPileSize( DeckPile pile ) const;
+
+	/// Returns total quantity of cards.
+	int GetNumCards() const;
+
+	/// Returns all cards to the draw pile in O(1).
+	void Reset();
+
+	/// Explicitly set random engine.
+	void SetRandomEngine( RandomEngineType&& randomEngine );
+
+private:
+
+	void Move( int slot, int fromPile, int toPile );
+
+	void Swap( int slotA, int slotB );
+
+private:
+
+	static const int NumPiles = 4;
+
+	RandomEngineType m_randomEngine;
+	std::vector< int > m_cards;
+	std::vector< int > m_slots;
+	int m_pileBegins[ NumPiles + 1 ] = { 0 };
+
+public:
+
+	/// If true, refill an empty draw pile from the discard pile on Draw()
+	bool bAutoReshuffle = { true };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< typename RandomEngineType >
+DeckMarbleBag< RandomEngineType >::DeckMarbleBag( int numCards, RandomEngineType&& randomEngine )
+	: m_randomEngine( std::forward< RandomEngineType >( randomEngine ) )
+	, m_cards( numCards )
+	, m_slots( numCards )
+{
+	for( int card = 0; card < numCards; ++card )
+	{
+		m_cards[ card ] = card;
+		m_slots[ card ] = card;
+	}
+	Reset();
+}
+
+template< typename RandomEngineType >
+DeckMarbleBag< RandomEngineType >::DeckMarbleBag( int numCards )
+	: DeckMarbleBag( numCards, std::move( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
+{}
+
+template< typename RandomEngineType >
+void DeckMarbleBag< RandomEngineType >::SetRandomEngine( RandomEngineType&& randomEngine )
+{
+	m_randomEngine = std::forward< RandomEngineType >( randomEngine );
+}
+
+template< typename RandomEngineType >
+void DeckMarbleBag< RandomEngineType >::Reset()
+{
+	for( int pile = 1; pile <= NumPiles; ++pile )
+	{
+		m_pileBegins[ pile ] = GetNumCards();
+	}
+}
+
+template< typename RandomEngineType >
+int DeckMarbleBag< RandomEngineType >::GetNumCards() const
+{
+	return static_cast< int >( m_cards.size() );
+}
+
+template< typename RandomEngineType >
+int DeckMarbleBag< RandomEngineType >::GetPileSize( DeckPile pile ) const
+{
+	return m_pileBegins[ static_cast< int >( pile ) + 1 ] - m_pileBegins[ static_cast< int >( pile ) ];
+}
+
+template< typename RandomEngineType >
+const int* DeckMarbleBag< RandomEngineType >::GetPile( DeckPile pile ) const
+{
+	return m_cards.data() + m_pileBegins[ static_cast< int >( pile ) ];
+}
+
+template< typename RandomEngineType >
+DeckPile DeckMarbleBag< RandomEngineType >::FindPile( int card ) const
+{
+	int slot = m_slots[ card ];
+	int pile = 0;
+	while( slot >= m_pileBegins[ pile + 1 ] )
+	{
+		++pile;
+	}
+	return static_cast< DeckPile >( pile );
+}
+
+template< typename RandomEngineType >
+bool DeckMarbleBag< RandomEngineType >::MoveCard( int card, DeckPile pile )
+{
+	if( card < 0 || card >= GetNumCards() )
+	{
+		return false;
+	}
+	Move( m_slots[ card ], static_cast< int >( FindPile( card ) ), static_cast< int >( pile ) );
+	return true;
+}
+
+template< typename RandomEngineType >
+void DeckMarbleBag< RandomEngineType >::ReshuffleDiscard()
+{
+	m_pileBegins[ static_cast< int >( DeckPile::Discard ) ] = m_pileBegins[ static_cast< int >( DeckPile::Hand ) ];
+}
+
+template< typename RandomEngineType >
+void DeckMarbleBag< RandomEngineType >::DiscardHand()
+{
+	m_pileBegins[ static_cast< int >( DeckPile::Hand ) ] = m_pileBegins[ static_cast< int >( DeckPile::InPlay ) ];
+}
+
+template< typename RandomEngineType >
+void DeckMarbleBag< RandomEngineType >::DiscardInPlay()
+{
+	while( GetPileSize( DeckPile::InPlay ) > 0 )
+	{
+		Move( m_pileBegins[ static_cast< int >( DeckPile::InPlay ) ], static_cast< int >( DeckPile::InPlay ), static_cast< int >( DeckPile::Discard ) );
+	}
+}
+
+template< typename RandomEngineType >
+bool DeckMarbleBag< RandomEngineType >::Discard( int card )
+{
+	if( card < 0 || card >= GetNumCards() )
+	{
+		return false;
+	}
+	DeckPile pile = FindPile( card );
+	if( pile != DeckPile::Hand && pile != DeckPile::InPlay )
+	{
+		return false;
+	}
+	Move( m_slots[ card ], static_cast< int >( pile ), static_cast< int >( DeckPile::Discard ) );
+	return true;
+}
+
+template< typename RandomEngineType >
+bool DeckMarbleBag< RandomEngineType >::Play( int card )
+{
+	if( card < 0 || card >= GetNumCards() || FindPile( card ) != DeckPile::Hand )
+	{
+		return false;
+	}
+	Move( m_slots[ card ], static_cast< int >( DeckPile::Hand ), static_cast< int >( DeckPile::InPlay ) );
+	return true;
+}
+
+template< typename RandomEngineType >
+int DeckMarbleBag< RandomEngineType >::Draw()
+{
+	if( GetPileSize( DeckPile::Draw ) == 0 && bAutoReshuffle )
+	{
+		ReshuffleDiscard();
+	}
+	int numDrawable = GetPileSize( DeckPile::Draw );
+	if( numDrawable == 0 )
+	{
+		return -1;
+	}
+	std::uniform_int_distribution< int > distribution( 0, numDrawable - 1 );
+	int slot = distribution( m_randomEngine );
+	int card = m_cards[ slot ];
+	Move( slot, static_cast< int >( DeckPile::Draw ), static_cast< int >( DeckPile::Hand ) );
+	return card;
+}
+
+template< typename RandomEngineType >
+int DeckMarbleBag< RandomEngineType >::Draw( int* outCards, int count )
+{
+	for( int numDrawn = 0; numDrawn < count; ++numDrawn )
+	{
+		int card = Draw();
+		if( card < 0 )
+		{
+			return numDrawn;
+		}
+		outCards[ numDrawn ] = card;
+	}
+	return count;
+}
+
+//
+// Private
+//
+
+template< typename RandomEngineType >
+void DeckMarbleBag< RandomEngineType >::Move( int slot, int fromPile, int toPile )
+{
+	// Each step swaps the card to the edge of its pile facing toPile and moves that boundary past it.
+	for( ; fromPile < toPile; ++fromPile )
+	{
+		int lastSlot = --m_pileBegins[ fromPile + 1 ];
+		Swap( slot, lastSlot );
+		slot = lastSlot;
+	}
+	for( ; fromPile > toPile; --fromPile )
+	{
+		int firstSlot = m_pileBegins[ fromPile ]++;
+		Swap( slot, firstSlot );
+		slot = firstSlot;
+	}
+}
+
+template< typename RandomEngineType >
+void DeckMarbleBag< RandomEngineType >::Swap( int slotA, int slotB )
+{
+	std::swap( m_cards[ slotA ], m_cards[ slotB ] );
+	m_slots[ m_cards[ slotA ] ] = slotA;
+	m_slots[ m_cards[ slotB ] ] = slotB;
+}
+
+}
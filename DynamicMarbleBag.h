@@ -0,0 +1,666 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* DynamicMarbleBag.h
+* MarbleBag with the number of marbles chosen at runtime.
+* Removed marbles are kept in 64-bit words and GetNext() selects the rolled marble with a
+* popcount per word instead of a per-index scan. For the same random engine state it returns
+* the same sequence as MarbleBag< N >. Observers receive the number of words examined as probeLength.
+* Move constructor and move assignment only, no copy.
+*
+* Usage:
+*	DynamicMarbleBag<> bag( 100 );														// Values from [0, 99], chrono-based seed
+*	DynamicMarbleBag<> bag( 100, std::move( std::default_random_engine{ 2017 } ) );	// Constructed with explicit seed
+*	int randomVal = bag.GetNext();														// Get next random marble value
+*	int numWritten = bag.GetNext( values, 4096 );										// Batch of draws, stops early if exhausted without bAutoReset
+*	std::int64_t numDrawn = bag.FastForward( 20000, counts.data() );					// Counts per value of the next 20000 draws, O(N) regardless of draw count
+*	bag.PutBack( value ); bag.Remove( ownedValue );										// Return a drawn marble, or take out one that must not be drawn this cycle
+*	int reward = bag.GetNextExcluding( ownedWords.data() );							// Next marble outside the owned bit words, -1 if none remain
+*	for( int value : bag.GetRemainingMarbles() ) { ... }								// Values still in the bag, ascending, one tzcnt per value
+*	bag.SplitRemaining( regions, 4 ); bag.MergeRemaining( regions[ 0 ] );				// Word-wide set algebra on remaining marbles, also IntersectRemaining() and SubtractRemaining()
+*	bag.Resize( 120, ResizePolicy::JoinProportionally );								// Grow or shrink mid-cycle, also AddValue() and swap-with-last EraseValue()
+*	ParallelForEach( bags.data(), bags.size(), numThreads, 4096, []( auto& bag ) { bag.EraseValue( 7 ); } );	// Migrate a pool in one pass, see MarbleBagParallel.h
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "MarbleBag.h"
+#include "MarbleBagBits.h"
+#include "MarbleBagObserver.h"
+
+namespace crux
+{
+/// Which cycle marbles added by Resize() or AddValue() take part in.
+enum class ResizePolicy
+{
+	JoinCurrentCycle,		///< New marbles are in the bag right away
+	JoinNextCycle,			///< New marbles count as removed until the next reset
+	JoinProportionally		///< Each new marble is in the bag with probability remaining / old N, so it expects the same draws this cycle as the others
+};
+
+/// Utility for dependent probability of random integers, runtime sized.
+template< typename RandomEngineType = std::default_random_engine, typename ObserverType = NullMarbleBagObserver >
+class DynamicMarbleBag : private ObserverType
+{
+public:
+
+	/// Constructor with chrono-based seed
+	explicit DynamicMarbleBag( int numMarbles );
+
+	/// Constructor with move of random engine type
+	DynamicMarbleBag( int numMarbles, RandomEngineType&& randomEngine );
+
+	/// Destructor
+	~DynamicMarbleBag() = default;
+
+	/// No copy operations
+	DynamicMarbleBag( const DynamicMarbleBag< RandomEngineType, ObserverType >& other ) = delete;
+	DynamicMarbleBag& operator=( const DynamicMarbleBag< RandomEngineType, ObserverType >& other ) = delete;
+
+	/// Move operations
+	DynamicMarbleBag( DynamicMarbleBag< RandomEngineType, ObserverType >&& other ) = default;
+	DynamicMarbleBag& operator=( DynamicMarbleBag< RandomEngineType, ObserverType >&& other ) = default;
+
+	/// Returns next marble value. Returns -1 if no marbles remain. Use Reset() to restore marbles.
+	const int GetNext();
+
+	/// Writes up to count next marble values. Returns number written, less than count only if marbles ran out without bAutoReset.
+	int GetNext( int* outValues, int count );
+
+	/// Returns next marble value whose bit is clear in excludedWords ( GetNumWords( GetNumMarbles() ) words, marble i in bit i % 64
+	/// of word i / 64 ), selected uniformly among them. Returns -1 if none remain.
+	const int GetNextExcluding( const std::uint64_t* excludedWords, ExcludedMarblePolicy policy = ExcludedMarblePolicy::Keep );
+
+	/// Advances as if GetNext() were called numDraws times, writing how often each value was drawn to outValueCounts[ GetNumMarbles() ].
+	/// Returns draws taken, less than numDraws only if marbles ran out without bAutoReset. Observers see resets, not individual draws.
+	std::int64_t FastForward( std::int64_t numDraws, std::int64_t* outValueCounts );
+
+	/// Returns a drawn marble value to the bag. Returns false if value is out of range or still in the bag. Observers are not notified.
+	bool PutBack( int value );
+
+	/// Removes a marble value without drawing it. Returns false if value is out of range or already removed. Observers are not notified.
+	bool Remove( int value );
+
+	/// Changes the number of marbles without starting a new cycle. Values at or above numMarbles leave the bag whatever their state,
+	/// values added above the old count join this cycle as policy says. Observers are not notified.
+	void Resize( int numMarbles, ResizePolicy policy = ResizePolicy::JoinProportionally );
+
+	/// Adds one marble value after the last and returns it.
+	int AddValue( ResizePolicy policy = ResizePolicy::JoinProportionally );
+
+	/// Removes value for good by moving the last value, with its state this cycle, into its place, matching a swap-and-pop of the
+	/// caller's value table. Returns false if value is out of range. Observers are not notified.
+	bool EraseValue( int value );
+
+	/// Returns quantity of marble values that still exist.
+	const int GetRemainingCount() const;
+
+	/// Returns range of marble values still in the bag, ascending. Iterating costs O( remaining + N / 64 ). Any change to the bag invalidates the range.
+	detail::BitIndexRange GetRemainingMarbles() const;
+
+	/// Returns range of marble values removed this cycle, ascending. Any change to the bag invalidates the range.
+	detail::BitIndexRange GetRemovedMarbles() const;
+
+	/// Returns total quantity of marble values.
+	const int GetNumMarbles() const;
+
+	/// Returns if any marble values remain.
+	bool HasMarbles() const;
+
+	/// Returns all marble values to bag.
+	void Reset();
+
+	/// Splits remaining marbles into numParts bags of the same size, replacing their marble state. Part p receives the p-th of numParts
+	/// equal shares of the remaining values in ascending order. This bag is unchanged and must not be one of the parts. Returns false on a size mismatch.
+	bool SplitRemaining( DynamicMarbleBag< RandomEngineType, ObserverType >* outParts, int numParts ) const;
+
+	/// Adds other's remaining marbles to this bag's remaining marbles. Returns false on a size mismatch.
+	bool MergeRemaining( const DynamicMarbleBag< RandomEngineType, ObserverType >& other );
+
+	/// Keeps only remaining marbles also remaining in other. Returns false on a size mismatch.
+	bool IntersectRemaining( const DynamicMarbleBag< RandomEngineType, ObserverType >& other );
+
+	/// Removes remaining marbles that are also remaining in other. Returns false on a size mismatch.
+	bool SubtractRemaining( const DynamicMarbleBag< RandomEngineType, ObserverType >& other );
+
+	/// Explicitly set random engine.
+	void SetRandomEngine( RandomEngineType&& randomEngine );
+
+	/// Returns observer receiving draw and reset callbacks.
+	ObserverType& GetObserver();
+	const ObserverType& GetObserver() const;
+
+private:
+
+	int Roll();
+
+	int Select( int numToVisit ) const;
+
+	void RemoveRandomSubset( int numToRemove, std::int64_t* outValueCounts );
+
+private:
+
+	RandomEngineType m_randomEngine;
+	std::vector< std::uint64_t > m_removedWords;
+	int m_numMarbles;
+	int m_numRemoved = { 0 };
+
+public:
+
+	/// If true, auto reset marble bag when empty
+	bool bAutoReset = { true };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< typename RandomEngineType, typename ObserverType >
+void DynamicMarbleBag< RandomEngineType, ObserverType >::SetRandomEngine( RandomEngineType&& randomEngine )
+{
+	m_randomEngine = std::forward< RandomEngineType >( randomEngine );
+}
+
+template< typename RandomEngineType, typename ObserverType >
+ObserverType& DynamicMarbleBag< RandomEngineType, ObserverType >::GetObserver()
+{
+	return *this;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+const ObserverType& DynamicMarbleBag< RandomEngineType, ObserverType >::GetObserver() const
+{
+	return *this;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+void DynamicMarbleBag< RandomEngineType, ObserverType >::Reset()
+{
+	GetObserver().OnReset( m_numRemoved, GetRemainingCount() );
+	std::fill( m_removedWords.begin(), m_removedWords.end(), 0 );
+	m_numRemoved = 0;
+	GetObserver().OnResetEnd();
+}
+
+template< typename RandomEngineType, typename ObserverType >
+bool DynamicMarbleBag< RandomEngineType, ObserverType >::SplitRemaining( DynamicMarbleBag< RandomEngineType, ObserverType >* outParts, int numParts ) const
+{
+	for( int part = 0; part < numParts; ++part )
+	{
+		if( outParts[ part ].m_numMarbles != m_numMarbles )
+		{
+			return false;
+		}
+	}
+	// One pass over the words: whole words go to the current part while its share allows, a word
+	// straddling two shares is cut at the selected bit.
+	int numWords = static_cast< int >( m_removedWords.size() );
+	int numRemaining = GetRemainingCount();
+	int wordIdx = 0;
+	std::uint64_t takenBits = 0;
+	for( int part = 0; part < numParts; ++part )
+	{
+		int numShare = static_cast< int >( static_cast< long long >( part + 1 ) * numRemaining / numParts - static_cast< long long >( part ) * numRemaining / numParts );
+		std::vector< std::uint64_t >& partWords = outParts[ part ].m_removedWords;
+		std::fill( partWords.begin(), partWords.end(), ~std::uint64_t( 0 ) );
+		for( int numNeeded = numShare; numNeeded > 0; )
+		{
+			std::uint64_t available = ~( m_removedWords[ wordIdx ] | takenBits );
+			available &= wordIdx == numWords - 1 ? detail::GetLastWordMask( m_numMarbles ) : ~std::uint64_t( 0 );
+			int numAvailable = detail::PopCount( available );
+			if( numAvailable <= numNeeded )
+			{
+				partWords[ wordIdx ] = ~available;
+				numNeeded -= numAvailable;
+				takenBits = 0;
+				++wordIdx;
+			}
+			else
+			{
+				int cutBit = detail::SelectBit( available, numNeeded - 1 );
+				std::uint64_t share = available & ( cutBit == detail::BitsPerWord - 1 ? ~std::uint64_t( 0 ) : ( std::uint64_t( 2 ) << cutBit ) - 1 );
+				partWords[ wordIdx ] = ~share;
+				takenBits |= share;
+				numNeeded = 0;
+			}
+		}
+		if( numWords > 0 )
+		{
+			partWords.back() &= detail::GetLastWordMask( m_numMarbles );
+		}
+		outParts[ part ].m_numRemoved = m_numMarbles - numShare;
+	}
+	return true;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+bool DynamicMarbleBag< RandomEngineType, ObserverType >::MergeRemaining( const DynamicMarbleBag< RandomEngineType, ObserverType >& other )
+{
+	if( other.m_numMarbles != m_numMarbles )
+	{
+		return false;
+	}
+	int numRemoved = 0;
+	for( std::size_t w = 0; w < m_removedWords.size(); ++w )
+	{
+		m_removedWords[ w ] &= other.m_removedWords[ w ];
+		numRemoved += detail::PopCount( m_removedWords[ w ] );
+	}
+	m_numRemoved = numRemoved;
+	return true;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+bool DynamicMarbleBag< RandomEngineType, ObserverType >::IntersectRemaining( const DynamicMarbleBag< RandomEngineType, ObserverType >& other )
+{
+	if( other.m_numMarbles != m_numMarbles )
+	{
+		return false;
+	}
+	int numRemoved = 0;
+	for( std::size_t w = 0; w < m_removedWords.size(); ++w )
+	{
+		m_removedWords[ w ] |= other.m_removedWords[ w ];
+		numRemoved += detail::PopCount( m_removedWords[ w ] );
+	}
+	m_numRemoved = numRemoved;
+	return true;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+bool DynamicMarbleBag< RandomEngineType, ObserverType >::SubtractRemaining( const DynamicMarbleBag< RandomEngineType, ObserverType >& other )
+{
+	if( other.m_numMarbles != m_numMarbles )
+	{
+		return false;
+	}
+	int numRemoved = 0;
+	for( std::size_t w = 0; w < m_removedWords.size(); ++w )
+	{
+		m_removedWords[ w ] |= ~other.m_removedWords[ w ];
+		if( w + 1 == m_removedWords.size() )
+		{
+			m_removedWords[ w ] &= detail::GetLastWordMask( m_numMarbles );
+		}
+		numRemoved += detail::PopCount( m_removedWords[ w ] );
+	}
+	m_numRemoved = numRemoved;
+	return true;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+detail::BitIndexRange DynamicMarbleBag< RandomEngineType, ObserverType >::GetRemainingMarbles() const
+{
+	return detail::BitIndexRange( m_removedWords.data(), m_numMarbles, true );
+}
+
+template< typename RandomEngineType, typename ObserverType >
+detail::BitIndexRange DynamicMarbleBag< RandomEngineType, ObserverType >::GetRemovedMarbles() const
+{
+	return detail::BitIndexRange( m_removedWords.data(), m_numMarbles, false );
+}
+
+template< typename RandomEngineType, typename ObserverType >
+bool DynamicMarbleBag< RandomEngineType, ObserverType >::PutBack( int value )
+{
+	if( value < 0 || value >= m_numMarbles )
+	{
+		return false;
+	}
+	std::uint64_t bit = std::uint64_t( 1 ) << ( value % detail::BitsPerWord );
+	std::uint64_t& word = m_removedWords[ value / detail::BitsPerWord ];
+	if( ( word & bit ) == 0 )
+	{
+		return false;
+	}
+	word &= ~bit;
+	--m_numRemoved;
+	return true;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+bool DynamicMarbleBag< RandomEngineType, ObserverType >::Remove( int value )
+{
+	if( value < 0 || value >= m_numMarbles )
+	{
+		return false;
+	}
+	std::uint64_t bit = std::uint64_t( 1 ) << ( value % detail::BitsPerWord );
+	std::uint64_t& word = m_removedWords[ value / detail::BitsPerWord ];
+	if( ( word & bit ) != 0 )
+	{
+		return false;
+	}
+	word |= bit;
+	++m_numRemoved;
+	return true;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+void DynamicMarbleBag< RandomEngineType, ObserverType >::Resize( int numMarbles, ResizePolicy policy )
+{
+	int oldNumMarbles = m_numMarbles;
+	int numRemaining = GetRemainingCount();
+	m_removedWords.resize( detail::GetNumWords( numMarbles ), 0 );
+	m_numMarbles = numMarbles;
+	if( numMarbles <= oldNumMarbles )
+	{
+		int numRemoved = 0;
+		if( !m_removedWords.empty() )
+		{
+			m_removedWords.back() &= detail::GetLastWordMask( numMarbles );
+		}
+		for( std::uint64_t word : m_removedWords )
+		{
+			numRemoved += detail::PopCount( word );
+		}
+		m_numRemoved = numRemoved;
+		return;
+	}
+
+	int numAdded = numMarbles - oldNumMarbles;
+	int numJoining = policy == ResizePolicy::JoinNextCycle ? 0 : numAdded;
+	std::uniform_int_distribution< int > distribution;
+	typedef std::uniform_int_distribution< int >::param_type RangeType;
+	if( policy == ResizePolicy::JoinProportionally && oldNumMarbles > 0 )
+	{
+		// numAdded * remaining / old N marbles join, the fractional part rounded up with its own probability.
+		long long scaled = static_cast< long long >( numAdded ) * numRemaining;
+		numJoining = static_cast< int >( scaled / oldNumMarbles );
+		int fraction = static_cast< int >( scaled % oldNumMarbles );
+		if( fraction > 0 && distribution( m_randomEngine, RangeType( 0, oldNumMarbles - 1 ) ) < fraction )
+		{
+			++numJoining;
+		}
+	}
+	// Selection sampling, so every subset of new values is equally likely to join.
+	for( int value = oldNumMarbles; value < numMarbles; ++value )
+	{
+		int numLeft = numMarbles - value;
+		if( numJoining == numLeft || ( numJoining > 0 && distribution( m_randomEngine, RangeType( 0, numLeft - 1 ) ) < numJoining ) )
+		{
+			--numJoining;
+		}
+		else
+		{
+			m_removedWords[ value / detail::BitsPerWord ] |= std::uint64_t( 1 ) << ( value % detail::BitsPerWord );
+			++m_numRemoved;
+		}
+	}
+}
+
+template< typename RandomEngineType, typename ObserverType >
+int DynamicMarbleBag< RandomEngineType, ObserverType >::AddValue( ResizePolicy policy )
+{
+	Resize( m_numMarbles + 1, policy );
+	return m_numMarbles - 1;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+bool DynamicMarbleBag< RandomEngineType, ObserverType >::EraseValue( int value )
+{
+	if( value < 0 || value >= m_numMarbles )
+	{
+		return false;
+	}
+	int lastValue = m_numMarbles - 1;
+	std::uint64_t& lastWord = m_removedWords[ lastValue / detail::BitsPerWord ];
+	std::uint64_t lastBit = ( lastWord >> ( lastValue % detail::BitsPerWord ) ) & 1;
+	std::uint64_t& word = m_removedWords[ value / detail::BitsPerWord ];
+	int shift = value % detail::BitsPerWord;
+	m_numRemoved -= static_cast< int >( ( word >> shift ) & 1 );
+	word = ( word & ~( std::uint64_t( 1 ) << shift ) ) | ( lastBit << shift );
+	lastWord &= ~( std::uint64_t( 1 ) << ( lastValue % detail::BitsPerWord ) );
+	m_numMarbles = lastValue;
+	m_removedWords.resize( detail::GetNumWords( m_numMarbles ) );
+	return true;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+bool DynamicMarbleBag< RandomEngineType, ObserverType >::HasMarbles() const
+{
+	return GetRemainingCount() > 0;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+const int DynamicMarbleBag< RandomEngineType, ObserverType >::GetNumMarbles() const
+{
+	return m_numMarbles;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+const int DynamicMarbleBag< RandomEngineType, ObserverType >::GetRemainingCount() const
+{
+	return ( m_numMarbles - m_numRemoved );
+}
+
+template< typename RandomEngineType, typename ObserverType >
+const int DynamicMarbleBag< RandomEngineType, ObserverType >::GetNext()
+{
+	GetObserver().OnGetNextBegin();
+	if( !HasMarbles() )
+	{
+		if( bAutoReset && m_numMarbles > 0 )
+		{
+			GetObserver().OnAutoReset();
+			Reset();
+		}
+		else
+		{
+			GetObserver().OnExhausted();
+			return -1;
+		}
+	}
+	GetObserver().OnRollBegin();
+	int numToVisit = Roll();
+	GetObserver().OnRollEnd();
+	int resultIdx = Select( numToVisit );
+	++m_numRemoved;
+	m_removedWords[ resultIdx / detail::BitsPerWord ] |= std::uint64_t( 1 ) << ( resultIdx % detail::BitsPerWord );
+	GetObserver().OnDraw( resultIdx, resultIdx == 0 ? static_cast< int >( m_removedWords.size() ) : resultIdx / detail::BitsPerWord + 1, GetRemainingCount() );
+	return resultIdx;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+const int DynamicMarbleBag< RandomEngineType, ObserverType >::GetNextExcluding( const std::uint64_t* excludedWords, ExcludedMarblePolicy policy )
+{
+	GetObserver().OnGetNextBegin();
+	if( !HasMarbles() )
+	{
+		if( bAutoReset && m_numMarbles > 0 )
+		{
+			GetObserver().OnAutoReset();
+			Reset();
+		}
+		else
+		{
+			GetObserver().OnExhausted();
+			return -1;
+		}
+	}
+	int numAvailable = detail::CountClearBits( m_removedWords.data(), excludedWords, m_numMarbles );
+	if( numAvailable == 0 )
+	{
+		GetObserver().OnExhausted();
+		return -1;
+	}
+	GetObserver().OnRollBegin();
+	std::uniform_int_distribution< int > distribution( 1, numAvailable );
+	int numToVisit = distribution( m_randomEngine );
+	GetObserver().OnRollEnd();
+	// Same order as Select(), so an empty mask reproduces the GetNext() sequence.
+	int resultIdx = detail::SelectClearBit( m_removedWords.data(), excludedWords, m_numMarbles, 1, numToVisit - 1 );
+	resultIdx = resultIdx < 0 ? 0 : resultIdx;
+	if( policy == ExcludedMarblePolicy::Remove )
+	{
+		int numWords = static_cast< int >( m_removedWords.size() );
+		for( int w = 0; w < numWords; ++w )
+		{
+			std::uint64_t newlyRemoved = excludedWords[ w ] & ~m_removedWords[ w ];
+			if( w == numWords - 1 )
+			{
+				newlyRemoved &= detail::GetLastWordMask( m_numMarbles );
+			}
+			m_numRemoved += detail::PopCount( newlyRemoved );
+			m_removedWords[ w ] |= newlyRemoved;
+		}
+	}
+	++m_numRemoved;
+	m_removedWords[ resultIdx / detail::BitsPerWord ] |= std::uint64_t( 1 ) << ( resultIdx % detail::BitsPerWord );
+	GetObserver().OnDraw( resultIdx, resultIdx == 0 ? static_cast< int >( m_removedWords.size() ) : resultIdx / detail::BitsPerWord + 1, GetRemainingCount() );
+	return resultIdx;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+int DynamicMarbleBag< RandomEngineType, ObserverType >::GetNext( int* outValues, int count )
+{
+	for( int i = 0; i < count; ++i )
+	{
+		int value = GetNext();
+		if( value < 0 )
+		{
+			return i;
+		}
+		outValues[ i ] = value;
+	}
+	return count;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+std::int64_t DynamicMarbleBag< RandomEngineType, ObserverType >::FastForward( std::int64_t numDraws, std::int64_t* outValueCounts )
+{
+	std::fill( outValueCounts, outValueCounts + m_numMarbles, 0 );
+	if( numDraws <= 0 || m_numMarbles == 0 )
+	{
+		return 0;
+	}
+	int numRemaining = GetRemainingCount();
+	if( numDraws <= numRemaining )
+	{
+		RemoveRandomSubset( static_cast< int >( numDraws ), outValueCounts );
+		return numDraws;
+	}
+
+	// Everything left in this cycle is drawn, then whole cycles draw every value once each.
+	for( int i = 0; i < m_numMarbles; ++i )
+	{
+		outValueCounts[ i ] = ( m_removedWords[ i / detail::BitsPerWord ] >> ( i % detail::BitsPerWord ) ) & 1 ? 0 : 1;
+	}
+	std::fill( m_removedWords.begin(), m_removedWords.end(), ~std::uint64_t( 0 ) );
+	m_removedWords.back() = detail::GetLastWordMask( m_numMarbles );
+	m_numRemoved = m_numMarbles;
+	if( !bAutoReset )
+	{
+		return numRemaining;
+	}
+	std::int64_t numCycles = ( numDraws - numRemaining ) / m_numMarbles;
+	int numPartial = static_cast< int >( ( numDraws - numRemaining ) % m_numMarbles );
+	for( int i = 0; i < m_numMarbles; ++i )
+	{
+		outValueCounts[ i ] += numCycles;
+	}
+	if( numPartial > 0 )
+	{
+		GetObserver().OnAutoReset();
+		Reset();
+		RemoveRandomSubset( numPartial, outValueCounts );
+	}
+	return numDraws;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+DynamicMarbleBag< RandomEngineType, ObserverType >::DynamicMarbleBag( int numMarbles, RandomEngineType&& randomEngine )
+	: m_randomEngine( std::forward< RandomEngineType >( randomEngine ) )
+	, m_removedWords( detail::GetNumWords( numMarbles ), 0 )
+	, m_numMarbles( numMarbles )
+{}
+
+template< typename RandomEngineType, typename ObserverType >
+DynamicMarbleBag< RandomEngineType, ObserverType >::DynamicMarbleBag( int numMarbles )
+	: DynamicMarbleBag( numMarbles, std::move( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
+{}
+
+//
+// Private
+//
+
+template< typename RandomEngineType, typename ObserverType >
+int DynamicMarbleBag< RandomEngineType, ObserverType >::Roll()
+{
+	std::uniform_int_distribution< int > distribution( 1, m_numMarbles - m_numRemoved );
+	return distribution( m_randomEngine );
+}
+
+template< typename RandomEngineType, typename ObserverType >
+int DynamicMarbleBag< RandomEngineType, ObserverType >::Select( int numToVisit ) const
+{
+	// Matches MarbleBag: count remaining marbles starting after index 0, wrapping to index 0 last.
+	int resultIdx = detail::SelectClearBit( m_removedWords.data(), m_numMarbles, 1, numToVisit - 1 );
+	return resultIdx < 0 ? 0 : resultIdx;
+}
+
+template< typename RandomEngineType, typename ObserverType >
+void DynamicMarbleBag< RandomEngineType, ObserverType >::RemoveRandomSubset( int numToRemove, std::int64_t* outValueCounts )
+{
+	// Uniform subset of the remaining marbles by partial Fisher-Yates. When more than half are drawn,
+	// the marbles that stay are picked instead, so at most half the remaining count is rolled.
+	std::vector< int > remaining;
+	remaining.reserve( GetRemainingCount() );
+	for( int wordIdx = 0; wordIdx < static_cast< int >( m_removedWords.size() ); ++wordIdx )
+	{
+		std::uint64_t word = ~m_removedWords[ wordIdx ];
+		if( wordIdx + 1 == static_cast< int >( m_removedWords.size() ) )
+		{
+			word &= detail::GetLastWordMask( m_numMarbles );
+		}
+		for( ; word != 0; word &= word - 1 )
+		{
+			remaining.push_back( wordIdx * detail::BitsPerWord + detail::CountTrailingZeros( word ) );
+		}
+	}
+	int numRemaining = static_cast< int >( remaining.size() );
+	bool bPickKept = numToRemove * 2 > numRemaining;
+	int numPicks = bPickKept ? numRemaining - numToRemove : numToRemove;
+	for( int i = 0; i < numPicks; ++i )
+	{
+		std::uniform_int_distribution< int > distribution( i, numRemaining - 1 );
+		std::swap( remaining[ i ], remaining[ distribution( m_randomEngine ) ] );
+	}
+	for( int i = bPickKept ? numPicks : 0, end = bPickKept ? numRemaining : numPicks; i < end; ++i )
+	{
+		m_removedWords[ remaining[ i ] / detail::BitsPerWord ] |= std::uint64_t( 1 ) << ( remaining[ i ] % detail::BitsPerWord );
+		++outValueCounts[ remaining[ i ] ];
+	}
+	m_numRemoved += numToRemove;
+}
+
+}
@@ -0,0 +1,343 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* GridMarbleBag.h
+* Dependent probability for cells of an N dimensional grid: every cell is drawn once per cycle.
+* A cycle walks a KeyedPermutation ( MarbleBagPermutation.h ) of the cell indexes with a fresh key per cycle,
+* so the state is the key and the cycle position regardless of grid size, and a draw costs a table lookup
+* for up to 64 cells or a few Feistel evaluations above, plus a coordinate decode. Either way each cycle
+* order is uniform enough that no cell is favoured early in a cycle, also with excluded regions.
+* Cell indexes are row major with dimension 0 varying fastest.
+* SetExcludedRegions() splits the grid into regions and leaves masked regions out of every cycle. It keeps the
+* region mask and an allowed cell count per mask word, about two bits per region; a draw adds a binary search
+* over the word counts and a select within one word.
+* Move constructor and move assignment only, no copy.
+*
+* Usage:
+*	const int extents[] = { 4096, 4096 };
+*	GridMarbleBag< 2 > bag( extents );														// 16M cells, chrono-based seed
+*	GridMarbleBag< 2 > bag( extents, std::move( std::default_random_engine{ 2017 } ) );	// Constructed with explicit seed
+*	int cell[ 2 ]; std::int64_t index = bag.GetNext( cell );								// Next unused cell, x in cell[ 0 ], y in cell[ 1 ]
+*	int numWritten = bag.GetNext( cells, 256 );											// 256 cells, coordinates interleaved in cells[ 256 * 2 ]
+*	bag.SetExcludedRegions( regionExtents, excludedRegionWords );							// Leave masked regions out, starts a new cycle
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "MarbleBagBits.h"
+#include "MarbleBagPermutation.h"
+
+namespace crux
+{
+/// Utility for dependent probability of grid cells, one draw per cell per cycle.
+template< int NumDimensions, typename RandomEngineType = std::default_random_engine >
+class GridMarbleBag
+{
+	static_assert( NumDimensions > 0, "GridMarbleBag needs at least one dimension" );
+
+public:
+
+	/// Constructor with chrono-based seed. extents holds NumDimensions sizes, at most 2^62 cells in total.
+	explicit GridMarbleBag( const int* extents );
+
+	/// Constructor with move of random engine type
+	GridMarbleBag( const int* extents, RandomEngineType&& randomEngine );
+
+	/// Destructor
+	~GridMarbleBag() = default;
+
+	/// No copy operations
+	GridMarbleBag( const GridMarbleBag< NumDimensions, RandomEngineType >& other ) = delete;
+	GridMarbleBag& operator=( const GridMarbleBag< NumDimensions, RandomEngineType >& other ) = delete;
+
+	/// Move operations
+	GridMarbleBag( GridMarbleBag< NumDimensions, RandomEngineType >&& other ) = default;
+	GridMarbleBag& operator=( GridMarbleBag< NumDimensions, RandomEngineType >&& other ) = default;
+
+	/// Writes coordinates of the next cell to outCoordinates[ NumDimensions ] and returns its cell index. Returns -1 if no cells remain.
+	std::int64_t GetNext( int* outCoordinates );
+
+	/// Writes coordinates of up to count next cells to outCoordinates[ count * NumDimensions ], one cell after another.
+	/// Returns number of cells written, less than count only if cells ran out without bAutoReset.
+	int GetNext( int* outCoordinates, int count );
+
+	/// Splits the grid into regions of regionExtents[ NumDimensions ] cells, edge regions clipped, and leaves regions whose bit is set in
+	/// excludedRegionWords out of every cycle. Region indexes are row major like cells, region i in bit i % 64 of word i / 64.
+	/// A null excludedRegionWords excludes none. Starts a new cycle. Returns false and changes nothing if the grid splits into more than 2^31 - 1 regions.
+	bool SetExcludedRegions( const int* regionExtents, const std::uint64_t* excludedRegionWords );
+
+	/// Makes every cell drawable again. Starts a new cycle.
+	void ClearExcludedRegions();
+
+	/// Returns quantity of cells left in the current cycle.
+	std::uint64_t GetRemainingCount() const;
+
+	/// Returns quantity of cells drawn per cycle, the grid minus excluded regions.
+	std::uint64_t GetNumCells() const;
+
+	/// Returns size of dimension.
+	int GetExtent( int dimension ) const;
+
+	/// Returns if any cells remain.
+	bool HasMarbles() const;
+
+	/// Returns all cells to bag with a new cycle order.
+	void Reset();
+
+	/// Explicitly set random engine.
+	void SetRandomEngine( RandomEngineType&& randomEngine );
+
+private:
+
+	std::int64_t Decode( std::uint64_t allowedIndex, int* outCoordinates ) const;
+
+	std::uint64_t GetRegionCellCount( std::uint64_t region ) const;
+
+private:
+
+	RandomEngineType m_randomEngine;
+	KeyedPermutation m_permutation;
+	std::uint64_t m_position = { 0 };
+	int m_extents[ NumDimensions ] = {};
+	int m_regionExtents[ NumDimensions ] = {};
+	int m_numRegions[ NumDimensions ] = {};
+	std::uint64_t m_regionVolume = { 0 };
+	std::vector< std::uint64_t > m_excludedWords;
+	std::vector< std::uint64_t > m_wordStarts;
+
+public:
+
+	/// If true, auto reset marble bag when empty
+	bool bAutoReset = { true };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< int NumDimensions, typename RandomEngineType >
+GridMarbleBag< NumDimensions, RandomEngineType >::GridMarbleBag( const int* extents, RandomEngineType&& randomEngine )
+	: m_randomEngine( std::forward< RandomEngineType >( randomEngine ) )
+{
+	std::copy( extents, extents + NumDimensions, m_extents );
+	ClearExcludedRegions();
+}
+
+template< int NumDimensions, typename RandomEngineType >
+GridMarbleBag< NumDimensions, RandomEngineType >::GridMarbleBag( const int* extents )
+	: GridMarbleBag( extents, std::move( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
+{}
+
+template< int NumDimensions, typename RandomEngineType >
+void GridMarbleBag< NumDimensions, RandomEngineType >::SetRandomEngine( RandomEngineType&& randomEngine )
+{
+	m_randomEngine = std::forward< RandomEngineType >( randomEngine );
+}
+
+template< int NumDimensions, typename RandomEngineType >
+void GridMarbleBag< NumDimensions, RandomEngineType >::Reset()
+{
+	std::uniform_int_distribution< std::uint64_t > distribution;
+	m_permutation = KeyedPermutation( GetNumCells(), distribution( m_randomEngine ) );
+	m_position = 0;
+}
+
+template< int NumDimensions, typename RandomEngineType >
+bool GridMarbleBag< NumDimensions, RandomEngineType >::HasMarbles() const
+{
+	return GetRemainingCount() > 0;
+}
+
+template< int NumDimensions, typename RandomEngineType >
+int GridMarbleBag< NumDimensions, RandomEngineType >::GetExtent( int dimension ) const
+{
+	return m_extents[ dimension ];
+}
+
+template< int NumDimensions, typename RandomEngineType >
+std::uint64_t GridMarbleBag< NumDimensions, RandomEngineType >::GetNumCells() const
+{
+	return m_wordStarts.back();
+}
+
+template< int NumDimensions, typename RandomEngineType >
+std::uint64_t GridMarbleBag< NumDimensions, RandomEngineType >::GetRemainingCount() const
+{
+	return GetNumCells() - m_position;
+}
+
+template< int NumDimensions, typename RandomEngineType >
+std::int64_t GridMarbleBag< NumDimensions, RandomEngineType >::GetNext( int* outCoordinates )
+{
+	if( m_position == GetNumCells() )
+	{
+		if( !bAutoReset || GetNumCells() == 0 )
+		{
+			return -1;
+		}
+		Reset();
+	}
+	return Decode( m_permutation( m_position++ ), outCoordinates );
+}
+
+template< int NumDimensions, typename RandomEngineType >
+int GridMarbleBag< NumDimensions, RandomEngineType >::GetNext( int* outCoordinates, int count )
+{
+	int numWritten = 0;
+	while( numWritten < count && GetNext( outCoordinates + static_cast< std::size_t >( numWritten ) * NumDimensions ) >= 0 )
+	{
+		++numWritten;
+	}
+	return numWritten;
+}
+
+template< int NumDimensions, typename RandomEngineType >
+bool GridMarbleBag< NumDimensions, RandomEngineType >::SetExcludedRegions( const int* regionExtents, const std::uint64_t* excludedRegionWords )
+{
+	int clippedExtents[ NumDimensions ];
+	int numRegionsPerDimension[ NumDimensions ];
+	std::uint64_t numRegions = 1;
+	for( int d = 0; d < NumDimensions; ++d )
+	{
+		clippedExtents[ d ] = std::max( 1, std::min( regionExtents[ d ], m_extents[ d ] ) );
+		numRegionsPerDimension[ d ] = m_extents[ d ] == 0 ? 0 : ( m_extents[ d ] + clippedExtents[ d ] - 1 ) / clippedExtents[ d ];
+		numRegions *= static_cast< std::uint64_t >( numRegionsPerDimension[ d ] );
+		if( numRegions > 0x7fffffff )
+		{
+			return false;
+		}
+	}
+	std::copy( clippedExtents, clippedExtents + NumDimensions, m_regionExtents );
+	std::copy( numRegionsPerDimension, numRegionsPerDimension + NumDimensions, m_numRegions );
+	m_regionVolume = 1;
+	for( int d = 0; d < NumDimensions; ++d )
+	{
+		m_regionVolume *= static_cast< std::uint64_t >( m_regionExtents[ d ] );
+	}
+
+	// Bits past the last region count as excluded, so each word can be scanned whole.
+	int numBits = static_cast< int >( numRegions );
+	int numWords = detail::GetNumWords( numBits );
+	m_excludedWords.assign( numWords, 0 );
+	if( excludedRegionWords != nullptr )
+	{
+		std::copy( excludedRegionWords, excludedRegionWords + numWords, m_excludedWords.begin() );
+	}
+	if( numWords > 0 )
+	{
+		m_excludedWords.back() |= ~detail::GetLastWordMask( numBits );
+	}
+	m_wordStarts.assign( numWords + 1, 0 );
+	for( int w = 0; w < numWords; ++w )
+	{
+		std::uint64_t numCells = 0;
+		for( std::uint64_t allowed = ~m_excludedWords[ w ]; allowed != 0; allowed &= allowed - 1 )
+		{
+			numCells += GetRegionCellCount( static_cast< std::uint64_t >( w ) * detail::BitsPerWord + detail::CountTrailingZeros( allowed ) );
+		}
+		m_wordStarts[ w + 1 ] = m_wordStarts[ w ] + numCells;
+	}
+	Reset();
+	return true;
+}
+
+template< int NumDimensions, typename RandomEngineType >
+void GridMarbleBag< NumDimensions, RandomEngineType >::ClearExcludedRegions()
+{
+	SetExcludedRegions( m_extents, nullptr );
+}
+
+//
+// Private
+//
+
+template< int NumDimensions, typename RandomEngineType >
+std::int64_t GridMarbleBag< NumDimensions, RandomEngineType >::Decode( std::uint64_t allowedIndex, int* outCoordinates ) const
+{
+	std::size_t word = 0;
+	if( m_wordStarts.size() > 2 )
+	{
+		word = static_cast< std::size_t >( std::upper_bound( m_wordStarts.begin() + 1, m_wordStarts.end(), allowedIndex ) - m_wordStarts.begin() - 1 );
+	}
+	std::uint64_t local = allowedIndex - m_wordStarts[ word ];
+	std::uint64_t allowed = ~m_excludedWords[ word ];
+	int bit = 0;
+	if( ( m_wordStarts[ word + 1 ] - m_wordStarts[ word ] ) / m_regionVolume == static_cast< std::uint64_t >( detail::PopCount( allowed ) ) )
+	{
+		// No clipped region in this word, every allowed region holds m_regionVolume cells.
+		bit = detail::SelectBit( allowed, static_cast< int >( local / m_regionVolume ) );
+		local %= m_regionVolume;
+	}
+	else
+	{
+		for( ;; allowed &= allowed - 1 )
+		{
+			bit = detail::CountTrailingZeros( allowed );
+			std::uint64_t numCells = GetRegionCellCount( static_cast< std::uint64_t >( word ) * detail::BitsPerWord + bit );
+			if( local < numCells )
+			{
+				break;
+			}
+			local -= numCells;
+		}
+	}
+	std::uint64_t region = static_cast< std::uint64_t >( word ) * detail::BitsPerWord + bit;
+	std::uint64_t cellIndex = 0;
+	std::uint64_t stride = 1;
+	for( int d = 0; d < NumDimensions; ++d )
+	{
+		int origin = static_cast< int >( region % m_numRegions[ d ] ) * m_regionExtents[ d ];
+		region /= m_numRegions[ d ];
+		std::uint64_t size = static_cast< std::uint64_t >( std::min( m_regionExtents[ d ], m_extents[ d ] - origin ) );
+		outCoordinates[ d ] = origin + static_cast< int >( local % size );
+		local /= size;
+		cellIndex += static_cast< std::uint64_t >( outCoordinates[ d ] ) * stride;
+		stride *= static_cast< std::uint64_t >( m_extents[ d ] );
+	}
+	return static_cast< std::int64_t >( cellIndex );
+}
+
+template< int NumDimensions, typename RandomEngineType >
+std::uint64_t GridMarbleBag< NumDimensions, RandomEngineType >::GetRegionCellCount( std::uint64_t region ) const
+{
+	// Edge regions are clipped to the grid.
+	std::uint64_t numCells = 1;
+	for( int d = 0; d < NumDimensions; ++d )
+	{
+		int origin = static_cast< int >( region % m_numRegions[ d ] ) * m_regionExtents[ d ];
+		region /= m_numRegions[ d ];
+		numCells *= static_cast< std::uint64_t >( std::min( m_regionExtents[ d ], m_extents[ d ] - origin ) );
+	}
+	return numCells;
+}
+
+}
@@ -0,0 +1,228 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* ItemBag.h
+* Dependent probability over items of any type, returned by reference.
+* The bag keeps its items in one contiguous array and shuffles them in place: the first GetRemainingCount()
+* items are still in the bag, and a draw swaps a random one of them to the end of that range. No index
+* array or lookup table is involved, the draw returns a reference into the array.
+* Owning mode takes a std::vector; view mode works directly on an existing array or std::span (C++20) and
+* reorders it in place. Items must be swappable; for large items prefer a bag of pointers or handles.
+* A returned reference stays valid for the life of the bag's storage and names the drawn item until a later cycle draws over its slot.
+* Move constructor and move assignment only, no copy.
+*
+* Usage:
+*	ItemBag< Piece > bag( std::move( pieces ) );									// Owns pieces, chrono-based seed
+*	ItemBag< Asset* > bag( assets.data(), numAssets );								// Views and reorders an existing array
+*	ItemBag< Asset* > bag( std::span< Asset* >( assets ), std::move( std::default_random_engine{ 2017 } ) );	// C++20 span view, explicit seed
+*	Piece& next = bag.GetNext();													// Next item, requires HasMarbles() or bAutoReset
+*	if( Piece* piece = bag.TryGetNext() ) { ... }									// nullptr once exhausted without bAutoReset
+*
+*/
+
+#pragma once
+
+#include <chrono>
+#include <random>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+namespace crux
+{
+/// Utility for dependent probability of typed items.
+template< typename ValueType, typename RandomEngineType = std::default_random_engine >
+class ItemBag
+{
+public:
+
+	/// Owning constructors
+	explicit ItemBag( std::vector< ValueType >&& items );
+	ItemBag( std::vector< ValueType >&& items, RandomEngineType&& randomEngine );
+
+	/// View constructors, items must outlive the bag
+	ItemBag( ValueType* items, int numItems );
+	ItemBag( ValueType* items, int numItems, RandomEngineType&& randomEngine );
+
+#if __cplusplus >= 202002L
+	explicit ItemBag( std::span< ValueType > items ) : ItemBag( items.data(), static_cast< int >( items.size() ) ) {}
+	ItemBag( std::span< ValueType > items, RandomEngineType&& randomEngine ) : ItemBag( items.data(), static_cast< int >( items.size() ), std::forward< RandomEngineType >( randomEngine ) ) {}
+#endif
+
+	/// Destructor
+	~ItemBag() = default;
+
+	/// No copy operations
+	ItemBag( const ItemBag< ValueType, RandomEngineType >& other ) = delete;
+	ItemBag& operator=( const ItemBag< ValueType, RandomEngineType >& other ) = delete;
+
+	/// Move operations
+	ItemBag( ItemBag< ValueType, RandomEngineType >&& other ) = default;
+	ItemBag& operator=( ItemBag< ValueType, RandomEngineType >&& other ) = default;
+
+	/// Returns next item. Bag must have items remaining or bAutoReset set, see TryGetNext().
+	ValueType& GetNext();
+
+	/// Returns next item, or nullptr if no items remain and bAutoReset is off.
+	ValueType* TryGetNext();
+
+	/// Returns quantity of items that still exist.
+	const int GetRemainingCount() const;
+
+	/// Returns total quantity of items.
+	const int GetNumItems() const;
+
+	/// Returns items in their current order: remaining items first, then this cycle's draws, latest first.
+	ValueType* GetItems();
+	const ValueType* GetItems() const;
+
+	/// Returns if any items remain.
+	bool HasMarbles() const;
+
+	/// Returns all items to bag.
+	void Reset();
+
+	/// Explicitly set random engine.
+	void SetRandomEngine( RandomEngineType&& randomEngine );
+
+private:
+
+	RandomEngineType m_randomEngine;
+	std::vector< ValueType > m_ownedItems;
+	ValueType* m_items = { nullptr };
+	int m_numItems = { 0 };
+	int m_numRemaining = { 0 };
+
+public:
+
+	/// If true, auto reset item bag when empty
+	bool bAutoReset = { true };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< typename ValueType, typename RandomEngineType >
+void ItemBag< ValueType, RandomEngineType >::SetRandomEngine( RandomEngineType&& randomEngine )
+{
+	m_randomEngine = std::forward< RandomEngineType >( randomEngine );
+}
+
+template< typename ValueType, typename RandomEngineType >
+void ItemBag< ValueType, RandomEngineType >::Reset()
+{
+	m_numRemaining = m_numItems;
+}
+
+template< typename ValueType, typename RandomEngineType >
+bool ItemBag< ValueType, RandomEngineType >::HasMarbles() const
+{
+	return m_numRemaining > 0;
+}
+
+template< typename ValueType, typename RandomEngineType >
+ValueType* ItemBag< ValueType, RandomEngineType >::GetItems()
+{
+	return m_items;
+}
+
+template< typename ValueType, typename RandomEngineType >
+const ValueType* ItemBag< ValueType, RandomEngineType >::GetItems() const
+{
+	return m_items;
+}
+
+template< typename ValueType, typename RandomEngineType >
+const int ItemBag< ValueType, RandomEngineType >::GetNumItems() const
+{
+	return m_numItems;
+}
+
+template< typename ValueType, typename RandomEngineType >
+const int ItemBag< ValueType, RandomEngineType >::GetRemainingCount() const
+{
+	return m_numRemaining;
+}
+
+template< typename ValueType, typename RandomEngineType >
+ValueType* ItemBag< ValueType, RandomEngineType >::TryGetNext()
+{
+	if( !HasMarbles() )
+	{
+		if( !bAutoReset || m_numItems == 0 )
+		{
+			return nullptr;
+		}
+		Reset();
+	}
+	std::uniform_int_distribution< int > distribution( 0, m_numRemaining - 1 );
+	int pickIdx = distribution( m_randomEngine );
+	--m_numRemaining;
+	if( pickIdx != m_numRemaining )
+	{
+		using std::swap;
+		swap( m_items[ pickIdx ], m_items[ m_numRemaining ] );
+	}
+	return &m_items[ m_numRemaining ];
+}
+
+template< typename ValueType, typename RandomEngineType >
+ValueType& ItemBag< ValueType, RandomEngineType >::GetNext()
+{
+	return *TryGetNext();
+}
+
+template< typename ValueType, typename RandomEngineType >
+ItemBag< ValueType, RandomEngineType >::ItemBag( ValueType* items, int numItems, RandomEngineType&& randomEngine )
+	: m_randomEngine( std::forward< RandomEngineType >( randomEngine ) )
+	, m_items( items )
+	, m_numItems( numItems )
+	, m_numRemaining( numItems )
+{}
+
+template< typename ValueType, typename RandomEngineType >
+ItemBag< ValueType, RandomEngineType >::ItemBag( ValueType* items, int numItems )
+	: ItemBag( items, numItems, std::move( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
+{}
+
+template< typename ValueType, typename RandomEngineType >
+ItemBag< ValueType, RandomEngineType >::ItemBag( std::vector< ValueType >&& items, RandomEngineType&& randomEngine )
+	: m_randomEngine( std::forward< RandomEngineType >( randomEngine ) )
+	, m_ownedItems( std::move( items ) )
+	, m_items( m_ownedItems.data() )
+	, m_numItems( static_cast< int >( m_ownedItems.size() ) )
+	, m_numRemaining( m_numItems )
+{}
+
+template< typename ValueType, typename RandomEngineType >
+ItemBag< ValueType, RandomEngineType >::ItemBag( std::vector< ValueType >&& items )
+	: ItemBag( std::move( items ), std::move( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
+{}
+
+}
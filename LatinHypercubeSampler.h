@@ -0,0 +1,256 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* LatinHypercubeSampler.h
+* Stratified samples over several dimensions, one DynamicMarbleBag of strata per dimension.
+* Each dimension's strata are all used once per cycle of GetNumStrata( dimension ) samples, so with equal
+* strata counts every cycle is a Latin hypercube sample. Batches are written in SoA layout, one contiguous
+* column per dimension. Cycle c of dimension d is drawn from an engine seeded with DeriveSeed() of
+* ( seed, d, c ) alone, so columns and runs of cycles are generated in parallel with ParallelFor() and
+* the output depends only on seed and position, never on thread count.
+* A non-positive strata count is rejected: the sampler is then constructed without dimensions.
+* Move constructor and move assignment only, no copy.
+*
+* Usage:
+*	const int strata[] = { 60, 40, 100 };
+*	LatinHypercubeSampler<> sampler( strata, 3, seed );									// Level, gear and skill axes
+*	sampler.GetNext( levels, 1 << 20, numThreads );										// levels[ d * count + i ] is the stratum of sample i on axis d
+*	sampler.Seek( 0 );																	// Back to the first sample
+*	sampler.GetNext( points, 1 << 20, numThreads );										// Same strata, jittered to [0, 1) floats within the stratum
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "DynamicMarbleBag.h"
+#include "MarbleBagParallel.h"
+
+namespace crux
+{
+/// Utility for stratified multi-dimensional sampling, one marble bag per dimension.
+template< typename RandomEngineType = std::default_random_engine >
+class LatinHypercubeSampler
+{
+public:
+
+	/// Constructor with numStrata[ numDimensions ] strata per dimension, each at least 1.
+	LatinHypercubeSampler( const int* numStrata, int numDimensions, std::uint64_t seed );
+
+	/// Destructor
+	~LatinHypercubeSampler() = default;
+
+	/// No copy operations
+	LatinHypercubeSampler( const LatinHypercubeSampler< RandomEngineType >& other ) = delete;
+	LatinHypercubeSampler& operator=( const LatinHypercubeSampler< RandomEngineType >& other ) = delete;
+
+	/// Move operations
+	LatinHypercubeSampler( LatinHypercubeSampler< RandomEngineType >&& other ) = default;
+	LatinHypercubeSampler& operator=( LatinHypercubeSampler< RandomEngineType >&& other ) = default;
+
+	/// Writes strata of the next count samples to outStrata[ GetNumDimensions() * count ], dimension d of sample i at d * count + i.
+	void GetNext( int* outStrata, std::uint64_t count, unsigned numThreads = 1 );
+
+	/// Writes the next count samples as points in [0, 1) to outPoints[ GetNumDimensions() * count ], dimension d of sample i at
+	/// d * count + i. A point is uniform within the stratum GetNext( int* ) returns for the same position.
+	void GetNext( float* outPoints, std::uint64_t count, unsigned numThreads = 1 );
+
+	/// Moves to sample position, 0 being the first sample after construction.
+	void Seek( std::uint64_t position );
+
+	/// Returns number of samples drawn so far.
+	std::uint64_t GetPosition() const;
+
+	/// Returns number of dimensions.
+	int GetNumDimensions() const;
+
+	/// Returns number of strata of dimension.
+	int GetNumStrata( int dimension ) const;
+
+private:
+
+	template< typename OutputType >
+	void Generate( OutputType* outColumns, std::uint64_t count, unsigned numThreads );
+
+	static void ToOutput( const int* strata, int numStrata, std::uint64_t cycleSeed, int* outValues );
+
+	static void ToOutput( const int* strata, int numStrata, std::uint64_t cycleSeed, float* outValues );
+
+	static bool AreStrataValid( const int* numStrata, int numDimensions );
+
+private:
+
+	/// Samples per parallel work item, rounded up to whole cycles.
+	static const int MinItemSamples = 4096;
+
+	std::vector< int > m_numStrata;
+	std::uint64_t m_seed;
+	std::uint64_t m_position = { 0 };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< typename RandomEngineType >
+LatinHypercubeSampler< RandomEngineType >::LatinHypercubeSampler( const int* numStrata, int numDimensions, std::uint64_t seed )
+	: m_numStrata( numStrata, numStrata + ( AreStrataValid( numStrata, numDimensions ) ? numDimensions : 0 ) )
+	, m_seed( seed )
+{}
+
+template< typename RandomEngineType >
+void LatinHypercubeSampler< RandomEngineType >::GetNext( int* outStrata, std::uint64_t count, unsigned numThreads )
+{
+	Generate( outStrata, count, numThreads );
+}
+
+template< typename RandomEngineType >
+void LatinHypercubeSampler< RandomEngineType >::GetNext( float* outPoints, std::uint64_t count, unsigned numThreads )
+{
+	Generate( outPoints, count, numThreads );
+}
+
+template< typename RandomEngineType >
+void LatinHypercubeSampler< RandomEngineType >::Seek( std::uint64_t position )
+{
+	m_position = position;
+}
+
+template< typename RandomEngineType >
+std::uint64_t LatinHypercubeSampler< RandomEngineType >::GetPosition() const
+{
+	return m_position;
+}
+
+template< typename RandomEngineType >
+int LatinHypercubeSampler< RandomEngineType >::GetNumDimensions() const
+{
+	return static_cast< int >( m_numStrata.size() );
+}
+
+template< typename RandomEngineType >
+int LatinHypercubeSampler< RandomEngineType >::GetNumStrata( int dimension ) const
+{
+	return m_numStrata[ dimension ];
+}
+
+//
+// Private
+//
+
+template< typename RandomEngineType >
+template< typename OutputType >
+void LatinHypercubeSampler< RandomEngineType >::Generate( OutputType* outColumns, std::uint64_t count, unsigned numThreads )
+{
+	if( count == 0 )
+	{
+		return;
+	}
+	// Work items are runs of whole cycles within one dimension; firstItems[ d ] is the first item of dimension d.
+	int numDimensions = GetNumDimensions();
+	std::uint64_t begin = m_position;
+	std::uint64_t end = m_position + count;
+	std::vector< std::uint64_t > firstItems( numDimensions + 1, 0 );
+	for( int d = 0; d < numDimensions; ++d )
+	{
+		std::uint64_t numStrata = static_cast< std::uint64_t >( m_numStrata[ d ] );
+		std::uint64_t cyclesPerItem = std::max< std::uint64_t >( 1, MinItemSamples / numStrata );
+		std::uint64_t numCycles = ( end - 1 ) / numStrata - begin / numStrata + 1;
+		firstItems[ d + 1 ] = firstItems[ d ] + ( numCycles + cyclesPerItem - 1 ) / cyclesPerItem;
+	}
+
+	ParallelFor( firstItems.back(), numThreads, 1, [ & ]( std::uint64_t firstItem, std::uint64_t lastItem, unsigned )
+	{
+		std::vector< int > strata;
+		std::vector< OutputType > values;
+		for( std::uint64_t item = firstItem; item < lastItem; ++item )
+		{
+			int d = static_cast< int >( std::upper_bound( firstItems.begin(), firstItems.end(), item ) - firstItems.begin() ) - 1;
+			int numStrata = m_numStrata[ d ];
+			std::uint64_t cyclesPerItem = std::max< std::uint64_t >( 1, MinItemSamples / static_cast< std::uint64_t >( numStrata ) );
+			std::uint64_t cycle = begin / numStrata + ( item - firstItems[ d ] ) * cyclesPerItem;
+			std::uint64_t dimensionSeed = DeriveSeed( m_seed, static_cast< std::uint64_t >( d ) );
+			OutputType* column = outColumns + static_cast< std::size_t >( d ) * count;
+
+			DynamicMarbleBag< RandomEngineType > bag( numStrata, RandomEngineType{} );
+			strata.resize( numStrata );
+			values.resize( numStrata );
+			for( std::uint64_t c = 0; c < cyclesPerItem && cycle * numStrata < end; ++c, ++cycle )
+			{
+				std::uint64_t cycleSeed = DeriveSeed( dimensionSeed, cycle );
+				bag.SetRandomEngine( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( cycleSeed ) } );
+				bag.Reset();
+				bag.GetNext( strata.data(), numStrata );
+				ToOutput( strata.data(), numStrata, cycleSeed, values.data() );
+
+				std::uint64_t cycleBegin = cycle * numStrata;
+				std::uint64_t from = std::max( cycleBegin, begin );
+				std::uint64_t to = std::min( cycleBegin + numStrata, end );
+				std::copy( values.begin() + static_cast< std::ptrdiff_t >( from - cycleBegin ), values.begin() + static_cast< std::ptrdiff_t >( to - cycleBegin ), column + ( from - begin ) );
+			}
+		}
+	} );
+	m_position = end;
+}
+
+template< typename RandomEngineType >
+void LatinHypercubeSampler< RandomEngineType >::ToOutput( const int* strata, int numStrata, std::uint64_t, int* outValues )
+{
+	std::copy( strata, strata + numStrata, outValues );
+}
+
+template< typename RandomEngineType >
+void LatinHypercubeSampler< RandomEngineType >::ToOutput( const int* strata, int numStrata, std::uint64_t cycleSeed, float* outValues )
+{
+	// Jitter has its own engine so strata match the int overload.
+	RandomEngineType jitterEngine{ static_cast< typename RandomEngineType::result_type >( DeriveSeed( cycleSeed, 0 ) ) };
+	std::uniform_real_distribution< double > distribution( 0.0, 1.0 );
+	const float belowOne = 1.0f - 1.0f / 16777216.0f;
+	for( int i = 0; i < numStrata; ++i )
+	{
+		float point = static_cast< float >( ( strata[ i ] + distribution( jitterEngine ) ) / numStrata );
+		outValues[ i ] = std::min( point, belowOne );
+	}
+}
+
+template< typename RandomEngineType >
+bool LatinHypercubeSampler< RandomEngineType >::AreStrataValid( const int* numStrata, int numDimensions )
+{
+	// Cycle and work item sizes divide by the strata count.
+	for( int d = 0; d < numDimensions; ++d )
+	{
+		if( numStrata[ d ] <= 0 )
+		{
+			return false;
+		}
+	}
+	return numDimensions >= 0;
+}
+
+}
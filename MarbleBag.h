@@ -30,22 +30,89 @@
 *	MarbleBag< 100 > bag;														// Default constructed with chrono-based seed
 *	MarbleBag< 100 > bag( std::move( std::default_random_engine{ 2017 } ) );	// Constructed with specified random engine initialized to explicit seed
 *	int randomVal = bag.GetNext();												// Get next random marble value
+*	int numWritten = bag.GetNext( values, 4096 );								// Batch of draws, stops early if exhausted without bAutoReset
+*	std::int64_t numDrawn = bag.FastForward( 20000, counts );					// Counts per value of the next 20000 draws, O(N) regardless of draw count
+*	bag.PutBack( value ); bag.Remove( ownedValue );								// Return a drawn marble, or take out one that must not be drawn this cycle
+*	int reward = bag.GetNextExcluding( owned );									// Next marble outside the owned bitset, -1 if none remain
+*	for( int value : bag.GetRemainingMarbles() ) { ... }						// Values still in the bag, ascending. GetRemovedMarbles() for the drawn ones
+*	bag.SplitRemaining( regions, 4 ); bag.MergeRemaining( regions[ 0 ] );		// Set algebra on remaining marbles, also IntersectRemaining() and SubtractRemaining()
 *	if( bag.HasMarbles() ) { bag.Reset(); }										// For bag reuse. Test if bag has values remaining, then reset bag.
+*	MarbleBag< 100, std::default_random_engine, CountingMarbleBagObserver<> > bag;	// Instrumented bag, see MarbleBagObserver.h
 *
 */
 
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <bitset>
+#include <cstdint>
 #include <functional>
 #include <random>
+#include <utility>
+#include <vector>
+
+#include "MarbleBagObserver.h"
 
 namespace crux
 {
+/// What GetNextExcluding() does with remaining marbles hidden by the mask.
+enum class ExcludedMarblePolicy
+{
+	Keep,		///< Masked marbles stay in the bag for later draws of this cycle
+	Remove		///< Masked marbles are removed along with the draw, forfeiting this cycle
+};
+
+namespace detail
+{
+/// Ascending indexes of the set bits of a bitset snapshot, for range-based for.
+/// Uses libstdc++'s word-wise bit search where available, otherwise tests bit by bit.
+template< int NumBits >
+class BitsetIndexRange
+{
+public:
+
+	class Iterator
+	{
+	public:
+
+		Iterator( const BitsetIndexRange* range, int index ) : m_range( range ), m_index( index ) {}
+
+		int operator*() const { return m_index; }
+		Iterator& operator++() { m_index = m_range->FindNext( m_index ); return *this; }
+		bool operator==( const Iterator& other ) const { return m_index == other.m_index; }
+		bool operator!=( const Iterator& other ) const { return m_index != other.m_index; }
+
+	private:
+
+		const BitsetIndexRange* m_range;
+		int m_index;
+	};
+
+	explicit BitsetIndexRange( const std::bitset< NumBits >& bits ) : m_bits( bits ) {}
+
+	Iterator begin() const { return Iterator( this, FindNext( -1 ) ); }
+	Iterator end() const { return Iterator( this, NumBits ); }
+
+private:
+
+	int FindNext( int index ) const
+	{
+#if defined( __GLIBCXX__ )
+		return static_cast< int >( index < 0 ? m_bits._Find_first() : m_bits._Find_next( static_cast< std::size_t >( index ) ) );
+#else
+		while( ++index < NumBits && !m_bits[ index ] ) {}
+		return index;
+#endif
+	}
+
+	std::bitset< NumBits > m_bits;
+};
+}
+
 /// Utility for dependent probability of random integers.
-template< int NumMarbles, typename RandomEngineType = std::default_random_engine >
-class MarbleBag
+template< int NumMarbles, typename RandomEngineType = std::default_random_engine, typename ObserverType = NullMarbleBagObserver >
+class MarbleBag : private ObserverType
 {
 public:
 
@@ -59,32 +126,73 @@ public:
 	~MarbleBag() = default;
 
 	/// No copy operations
-	MarbleBag( const MarbleBag< NumMarbles, RandomEngineType >& other ) = delete;
-	MarbleBag& operator=( const MarbleBag< NumMarbles, RandomEngineType >& other ) = delete;
+	MarbleBag( const MarbleBag< NumMarbles, RandomEngineType, ObserverType >& other ) = delete;
+	MarbleBag& operator=( const MarbleBag< NumMarbles, RandomEngineType, ObserverType >& other ) = delete;
 
 	/// Move operations
-	MarbleBag( MarbleBag< NumMarbles, RandomEngineType >&& other );
-	MarbleBag& operator=( MarbleBag< NumMarbles, RandomEngineType >&& other );
+	MarbleBag( MarbleBag< NumMarbles, RandomEngineType, ObserverType >&& other );
+	MarbleBag& operator=( MarbleBag< NumMarbles, RandomEngineType, ObserverType >&& other );
 
 	/// Returns next marble value. Returns -1 if no marbles remain. Use Reset() to restore marbles.
 	const int GetNext();
 
+	/// Writes up to count next marble values. Returns number written, less than count only if marbles ran out without bAutoReset.
+	int GetNext( int* outValues, int count );
+
+	/// Returns next marble value whose bit is clear in excludedMarbles, selected uniformly among them. Returns -1 if none remain.
+	const int GetNextExcluding( const std::bitset< NumMarbles >& excludedMarbles, ExcludedMarblePolicy policy = ExcludedMarblePolicy::Keep );
+
+	/// Advances as if GetNext() were called numDraws times, writing how often each value was drawn to outValueCounts[ NumMarbles ].
+	/// Returns draws taken, less than numDraws only if marbles ran out without bAutoReset. Observers see resets, not individual draws.
+	std::int64_t FastForward( std::int64_t numDraws, std::int64_t* outValueCounts );
+
+	/// Returns a drawn marble value to the bag. Returns false if value is out of range or still in the bag. Observers are not notified.
+	bool PutBack( int value );
+
+	/// Removes a marble value without drawing it. Returns false if value is out of range or already removed. Observers are not notified.
+	bool Remove( int value );
+
 	/// Returns quantity of marble values that still exist.
 	const int GetRemainingCount() const;
 
+	/// Returns range of marble values still in the bag, ascending. The range holds a snapshot taken at the call.
+	detail::BitsetIndexRange< NumMarbles > GetRemainingMarbles() const;
+
+	/// Returns range of marble values removed this cycle, ascending. The range holds a snapshot taken at the call.
+	detail::BitsetIndexRange< NumMarbles > GetRemovedMarbles() const;
+
 	/// Returns if any marble values remain.
 	bool HasMarbles() const;
 
 	/// Returns all marble values to bag.
 	void Reset();
 
+	/// Splits remaining marbles into numParts bags, replacing their marble state. Part p receives the p-th of numParts
+	/// equal shares of the remaining values in ascending order. This bag is unchanged and must not be one of the parts.
+	void SplitRemaining( MarbleBag< NumMarbles, RandomEngineType, ObserverType >* outParts, int numParts ) const;
+
+	/// Adds other's remaining marbles to this bag's remaining marbles.
+	void MergeRemaining( const MarbleBag< NumMarbles, RandomEngineType, ObserverType >& other );
+
+	/// Keeps only remaining marbles also remaining in other.
+	void IntersectRemaining( const MarbleBag< NumMarbles, RandomEngineType, ObserverType >& other );
+
+	/// Removes remaining marbles that are also remaining in other.
+	void SubtractRemaining( const MarbleBag< NumMarbles, RandomEngineType, ObserverType >& other );
+
 	/// Explicitly set random engine.
 	void SetRandomEngine( RandomEngineType&& randomEngine );
 
+	/// Returns observer receiving draw and reset callbacks.
+	ObserverType& GetObserver();
+	const ObserverType& GetObserver() const;
+
 private:
 
 	int Roll();
 
+	void RemoveRandomSubset( int numToRemove, std::int64_t* outValueCounts );
+
 private:
 
 	RandomEngineType m_randomEngine;
@@ -105,50 +213,154 @@ public:
 // Public 
 //
 
-template< int NumMarbles, typename RandomEngineType >
-void MarbleBag< NumMarbles, RandomEngineType >::SetRandomEngine( RandomEngineType&& randomEngine )
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+void MarbleBag< NumMarbles, RandomEngineType, ObserverType >::SetRandomEngine( RandomEngineType&& randomEngine )
 {
 	m_randomEngine = std::forward< RandomEngineType >( randomEngine );
 }
 
-template< int NumMarbles, typename RandomEngineType >
-void MarbleBag< NumMarbles, RandomEngineType >::Reset()
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+ObserverType& MarbleBag< NumMarbles, RandomEngineType, ObserverType >::GetObserver()
 {
+	return *this;
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+const ObserverType& MarbleBag< NumMarbles, RandomEngineType, ObserverType >::GetObserver() const
+{
+	return *this;
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+void MarbleBag< NumMarbles, RandomEngineType, ObserverType >::Reset()
+{
+	GetObserver().OnReset( m_numRemoved, GetRemainingCount() );
 	m_removedMarbles.reset();
 	m_numRemoved = 0;
+	GetObserver().OnResetEnd();
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+void MarbleBag< NumMarbles, RandomEngineType, ObserverType >::SplitRemaining( MarbleBag< NumMarbles, RandomEngineType, ObserverType >* outParts, int numParts ) const
+{
+	// Each share is the remaining set masked to a value range [ firstValue, endValue ) found by walking the remaining marbles.
+	detail::BitsetIndexRange< NumMarbles > remainingMarbles = GetRemainingMarbles();
+	typename detail::BitsetIndexRange< NumMarbles >::Iterator marble = remainingMarbles.begin();
+	int numRemaining = GetRemainingCount();
+	int firstValue = 0;
+	for( int part = 0; part < numParts; ++part )
+	{
+		int numShare = static_cast< int >( static_cast< long long >( part + 1 ) * numRemaining / numParts - static_cast< long long >( part ) * numRemaining / numParts );
+		for( int i = 0; i < numShare; ++i )
+		{
+			++marble;
+		}
+		int endValue = marble == remainingMarbles.end() ? NumMarbles : *marble;
+		std::bitset< NumMarbles > share;
+		share.set();
+		share >>= NumMarbles - ( endValue - firstValue );
+		share <<= firstValue;
+		outParts[ part ].m_removedMarbles = ~( share & ~m_removedMarbles );
+		outParts[ part ].m_numRemoved = NumMarbles - numShare;
+		firstValue = endValue;
+	}
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+void MarbleBag< NumMarbles, RandomEngineType, ObserverType >::MergeRemaining( const MarbleBag< NumMarbles, RandomEngineType, ObserverType >& other )
+{
+	m_removedMarbles &= other.m_removedMarbles;
+	m_numRemoved = static_cast< int >( m_removedMarbles.count() );
 }
 
-template< int NumMarbles, typename RandomEngineType >
-bool MarbleBag< NumMarbles, RandomEngineType >::HasMarbles() const
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+void MarbleBag< NumMarbles, RandomEngineType, ObserverType >::IntersectRemaining( const MarbleBag< NumMarbles, RandomEngineType, ObserverType >& other )
+{
+	m_removedMarbles |= other.m_removedMarbles;
+	m_numRemoved = static_cast< int >( m_removedMarbles.count() );
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+void MarbleBag< NumMarbles, RandomEngineType, ObserverType >::SubtractRemaining( const MarbleBag< NumMarbles, RandomEngineType, ObserverType >& other )
+{
+	m_removedMarbles |= ~other.m_removedMarbles;
+	m_numRemoved = static_cast< int >( m_removedMarbles.count() );
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+detail::BitsetIndexRange< NumMarbles > MarbleBag< NumMarbles, RandomEngineType, ObserverType >::GetRemainingMarbles() const
+{
+	return detail::BitsetIndexRange< NumMarbles >( ~m_removedMarbles );
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+detail::BitsetIndexRange< NumMarbles > MarbleBag< NumMarbles, RandomEngineType, ObserverType >::GetRemovedMarbles() const
+{
+	return detail::BitsetIndexRange< NumMarbles >( m_removedMarbles );
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+bool MarbleBag< NumMarbles, RandomEngineType, ObserverType >::PutBack( int value )
+{
+	if( value < 0 || value >= NumMarbles || !m_removedMarbles[ value ] )
+	{
+		return false;
+	}
+	m_removedMarbles[ value ] = false;
+	--m_numRemoved;
+	return true;
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+bool MarbleBag< NumMarbles, RandomEngineType, ObserverType >::Remove( int value )
+{
+	if( value < 0 || value >= NumMarbles || m_removedMarbles[ value ] )
+	{
+		return false;
+	}
+	m_removedMarbles[ value ] = true;
+	++m_numRemoved;
+	return true;
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+bool MarbleBag< NumMarbles, RandomEngineType, ObserverType >::HasMarbles() const
 {
 	return GetRemainingCount() > 0;
 }
 
-template< int NumMarbles, typename RandomEngineType >
-const int MarbleBag< NumMarbles, RandomEngineType >::GetRemainingCount() const
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+const int MarbleBag< NumMarbles, RandomEngineType, ObserverType >::GetRemainingCount() const
 {
 	return ( NumMarbles - m_numRemoved );
 }
 
-template< int NumMarbles, typename RandomEngineType >
-const int MarbleBag< NumMarbles, RandomEngineType >::GetNext()
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+const int MarbleBag< NumMarbles, RandomEngineType, ObserverType >::GetNext()
 {
+	GetObserver().OnGetNextBegin();
 	if( !HasMarbles() )
 	{
 		if( bAutoReset )
 		{
+			GetObserver().OnAutoReset();
 			Reset();
 		}
 		else
 		{
+			GetObserver().OnExhausted();
 			return -1;
 		}
 	}
+	GetObserver().OnRollBegin();
 	int numToVisit = Roll();
+	GetObserver().OnRollEnd();
 	int resultIdx = 0;
 	int numEmptyIndexesVisited = 0;
+	int probeLength = 0;
 	while( numEmptyIndexesVisited < numToVisit )
 	{
+		++probeLength;
 		if( ++resultIdx >= NumMarbles )
 		{
 			resultIdx = 0;
@@ -160,32 +372,147 @@ const int MarbleBag< NumMarbles, RandomEngineType >::GetNext()
 	}
 	++m_numRemoved;
 	m_removedMarbles[ resultIdx ] = true;
+	GetObserver().OnDraw( resultIdx, probeLength, GetRemainingCount() );
+	return resultIdx;
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+const int MarbleBag< NumMarbles, RandomEngineType, ObserverType >::GetNextExcluding( const std::bitset< NumMarbles >& excludedMarbles, ExcludedMarblePolicy policy )
+{
+	GetObserver().OnGetNextBegin();
+	if( !HasMarbles() )
+	{
+		if( bAutoReset )
+		{
+			GetObserver().OnAutoReset();
+			Reset();
+		}
+		else
+		{
+			GetObserver().OnExhausted();
+			return -1;
+		}
+	}
+	std::bitset< NumMarbles > unavailableMarbles = m_removedMarbles | excludedMarbles;
+	int numAvailable = NumMarbles - static_cast< int >( unavailableMarbles.count() );
+	if( numAvailable == 0 )
+	{
+		GetObserver().OnExhausted();
+		return -1;
+	}
+	GetObserver().OnRollBegin();
+	std::uniform_int_distribution< int > distribution( 1, numAvailable );
+	int numToVisit = distribution( m_randomEngine );
+	GetObserver().OnRollEnd();
+	// Same scan as GetNext(), so an empty mask reproduces its sequence.
+	int resultIdx = 0;
+	int numEmptyIndexesVisited = 0;
+	int probeLength = 0;
+	while( numEmptyIndexesVisited < numToVisit )
+	{
+		++probeLength;
+		if( ++resultIdx >= NumMarbles )
+		{
+			resultIdx = 0;
+		}
+		if( !unavailableMarbles[ resultIdx ] )
+		{
+			++numEmptyIndexesVisited;
+		}
+	}
+	if( policy == ExcludedMarblePolicy::Remove )
+	{
+		m_numRemoved += static_cast< int >( ( excludedMarbles & ~m_removedMarbles ).count() );
+		m_removedMarbles |= excludedMarbles;
+	}
+	++m_numRemoved;
+	m_removedMarbles[ resultIdx ] = true;
+	GetObserver().OnDraw( resultIdx, probeLength, GetRemainingCount() );
 	return resultIdx;
 }
 
-template< int NumMarbles, typename RandomEngineType >
-MarbleBag< NumMarbles, RandomEngineType >& MarbleBag< NumMarbles, RandomEngineType >::operator=( MarbleBag< NumMarbles, RandomEngineType >&& other )
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+int MarbleBag< NumMarbles, RandomEngineType, ObserverType >::GetNext( int* outValues, int count )
+{
+	for( int i = 0; i < count; ++i )
+	{
+		int value = GetNext();
+		if( value < 0 )
+		{
+			return i;
+		}
+		outValues[ i ] = value;
+	}
+	return count;
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+std::int64_t MarbleBag< NumMarbles, RandomEngineType, ObserverType >::FastForward( std::int64_t numDraws, std::int64_t* outValueCounts )
+{
+	std::fill( outValueCounts, outValueCounts + NumMarbles, 0 );
+	if( numDraws <= 0 )
+	{
+		return 0;
+	}
+	int numRemaining = GetRemainingCount();
+	if( numDraws <= numRemaining )
+	{
+		RemoveRandomSubset( static_cast< int >( numDraws ), outValueCounts );
+		return numDraws;
+	}
+
+	// Everything left in this cycle is drawn, then whole cycles draw every value once each.
+	for( int i = 0; i < NumMarbles; ++i )
+	{
+		outValueCounts[ i ] = m_removedMarbles[ i ] ? 0 : 1;
+	}
+	m_removedMarbles.set();
+	m_numRemoved = NumMarbles;
+	if( !bAutoReset )
+	{
+		return numRemaining;
+	}
+	std::int64_t numCycles = ( numDraws - numRemaining ) / NumMarbles;
+	int numPartial = static_cast< int >( ( numDraws - numRemaining ) % NumMarbles );
+	for( int i = 0; i < NumMarbles; ++i )
+	{
+		outValueCounts[ i ] += numCycles;
+	}
+	if( numPartial > 0 )
+	{
+		GetObserver().OnAutoReset();
+		Reset();
+		RemoveRandomSubset( numPartial, outValueCounts );
+	}
+	return numDraws;
+}
+
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+MarbleBag< NumMarbles, RandomEngineType, ObserverType >& MarbleBag< NumMarbles, RandomEngineType, ObserverType >::operator=( MarbleBag< NumMarbles, RandomEngineType, ObserverType >&& other )
 {
 	m_removedMarbles = std::move( other.m_removedMarbles );
 	m_randomEngine = std::move( other.m_randomEngine );
+	m_numRemoved = other.m_numRemoved;
+	bAutoReset = other.bAutoReset;
+	GetObserver() = std::move( other.GetObserver() );
 
 	return *this;
 }
 
-template< int NumMarbles, typename RandomEngineType >
-MarbleBag< NumMarbles, RandomEngineType >::MarbleBag( MarbleBag< NumMarbles, RandomEngineType >&& other )
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+MarbleBag< NumMarbles, RandomEngineType, ObserverType >::MarbleBag( MarbleBag< NumMarbles, RandomEngineType, ObserverType >&& other )
 {
-	*this = std::forward< MarbleBag< NumMarbles, RandomEngineType > >( other );
+	*this = std::forward< MarbleBag< NumMarbles, RandomEngineType, ObserverType > >( other );
 }
 
-template< int NumMarbles, typename RandomEngineType >
-MarbleBag< NumMarbles, RandomEngineType >::MarbleBag( RandomEngineType&& randomEngine )
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+MarbleBag< NumMarbles, RandomEngineType, ObserverType >::MarbleBag( RandomEngineType&& randomEngine )
 {
 	SetRandomEngine( ( std::forward< RandomEngineType >( randomEngine ) ) );
 }
 
-template< int NumMarbles, typename RandomEngineType >
-MarbleBag< NumMarbles, RandomEngineType >::MarbleBag()
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+MarbleBag< NumMarbles, RandomEngineType, ObserverType >::MarbleBag()
 	: MarbleBag( std::move( std::default_random_engine{ static_cast< std::uint32_t >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
 {}
 
@@ -193,11 +520,41 @@ MarbleBag< NumMarbles, RandomEngineType >::MarbleBag()
 // Private
 //
 
-template< int NumMarbles, typename RandomEngineType >
-int crux::MarbleBag< NumMarbles, RandomEngineType >::Roll()
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+int crux::MarbleBag< NumMarbles, RandomEngineType, ObserverType >::Roll()
 {
 	std::uniform_int_distribution< int > distribution( 1, NumMarbles - m_numRemoved );
 	return distribution( m_randomEngine );
 }
 
+template< int NumMarbles, typename RandomEngineType, typename ObserverType >
+void crux::MarbleBag< NumMarbles, RandomEngineType, ObserverType >::RemoveRandomSubset( int numToRemove, std::int64_t* outValueCounts )
+{
+	// Uniform subset of the remaining marbles by partial Fisher-Yates. When more than half are drawn,
+	// the marbles that stay are picked instead, so at most half the remaining count is rolled.
+	std::vector< int > remaining;
+	remaining.reserve( GetRemainingCount() );
+	for( int i = 0; i < NumMarbles; ++i )
+	{
+		if( !m_removedMarbles[ i ] )
+		{
+			remaining.push_back( i );
+		}
+	}
+	int numRemaining = static_cast< int >( remaining.size() );
+	bool bPickKept = numToRemove * 2 > numRemaining;
+	int numPicks = bPickKept ? numRemaining - numToRemove : numToRemove;
+	for( int i = 0; i < numPicks; ++i )
+	{
+		std::uniform_int_distribution< int > distribution( i, numRemaining - 1 );
+		std::swap( remaining[ i ], remaining[ distribution( m_randomEngine ) ] );
+	}
+	for( int i = bPickKept ? numPicks : 0, end = bPickKept ? numRemaining : numPicks; i < end; ++i )
+	{
+		m_removedMarbles[ remaining[ i ] ] = true;
+		++outValueCounts[ remaining[ i ] ];
+	}
+	m_numRemoved += numToRemove;
+}
+
 }
@@ -0,0 +1,242 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagBits.h
+* 64-bit word helpers shared by the word-based bag layouts.
+* Marble i lives in bit ( i % 64 ) of word ( i / 64 ). Uses compiler intrinsics where available.
+*
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#if defined( __BMI2__ )
+#include <immintrin.h>
+#endif
+
+namespace crux
+{
+namespace detail
+{
+const int BitsPerWord = 64;
+
+/// Returns number of words holding numBits bits.
+inline int GetNumWords( int numBits )
+{
+	return ( numBits + BitsPerWord - 1 ) / BitsPerWord;
+}
+
+/// Returns mask of the valid bits in the last word of a numBits bit set.
+inline std::uint64_t GetLastWordMask( int numBits )
+{
+	int usedBits = numBits % BitsPerWord;
+	return usedBits == 0 ? ~std::uint64_t( 0 ) : ( std::uint64_t( 1 ) << usedBits ) - 1;
+}
+
+/// Returns number of set bits.
+inline int PopCount( std::uint64_t word )
+{
+#if defined( __GNUC__ ) || defined( __clang__ )
+	return __builtin_popcountll( word );
+#elif defined( _MSC_VER ) && defined( _M_X64 )
+	return static_cast< int >( __popcnt64( word ) );
+#else
+	word = word - ( ( word >> 1 ) & 0x5555555555555555ull );
+	word = ( word & 0x3333333333333333ull ) + ( ( word >> 2 ) & 0x3333333333333333ull );
+	word = ( word + ( word >> 4 ) ) & 0x0f0f0f0f0f0f0f0full;
+	return static_cast< int >( ( word * 0x0101010101010101ull ) >> 56 );
+#endif
+}
+
+/// Returns index of lowest set bit. Word must not be zero.
+inline int CountTrailingZeros( std::uint64_t word )
+{
+#if defined( __GNUC__ ) || defined( __clang__ )
+	return __builtin_ctzll( word );
+#elif defined( _MSC_VER ) && defined( _M_X64 )
+	unsigned long index;
+	_BitScanForward64( &index, word );
+	return static_cast< int >( index );
+#else
+	int index = 0;
+	while( ( word & 1 ) == 0 )
+	{
+		word >>= 1;
+		++index;
+	}
+	return index;
+#endif
+}
+
+/// Returns index of the nth ( 0 based ) set bit. Word must have more than nth set bits.
+inline int SelectBit( std::uint64_t word, int nth )
+{
+#if defined( __BMI2__ )
+	return CountTrailingZeros( _pdep_u64( std::uint64_t( 1 ) << nth, word ) );
+#else
+	for( int i = 0; i < nth; ++i )
+	{
+		word &= word - 1;
+	}
+	return CountTrailingZeros( word );
+#endif
+}
+
+/// Returns index of the nth ( 0 based ) clear bit in bits [ firstBit, numBits ) of words, or -1 if fewer exist.
+inline int SelectClearBit( const std::uint64_t* words, int numBits, int firstBit, int nth )
+{
+	int numWords = GetNumWords( numBits );
+	for( int w = firstBit / BitsPerWord; w < numWords; ++w )
+	{
+		std::uint64_t clear = ~words[ w ];
+		if( w == numWords - 1 )
+		{
+			clear &= GetLastWordMask( numBits );
+		}
+		if( w == firstBit / BitsPerWord )
+		{
+			clear &= ~std::uint64_t( 0 ) << ( firstBit % BitsPerWord );
+		}
+		int count = PopCount( clear );
+		if( nth < count )
+		{
+			return w * BitsPerWord + SelectBit( clear, nth );
+		}
+		nth -= count;
+	}
+	return -1;
+}
+
+/// Returns index of the nth ( 0 based ) bit in bits [ firstBit, numBits ) clear in both words and maskWords, or -1 if fewer exist.
+inline int SelectClearBit( const std::uint64_t* words, const std::uint64_t* maskWords, int numBits, int firstBit, int nth )
+{
+	int numWords = GetNumWords( numBits );
+	for( int w = firstBit / BitsPerWord; w < numWords; ++w )
+	{
+		std::uint64_t clear = ~( words[ w ] | maskWords[ w ] );
+		if( w == numWords - 1 )
+		{
+			clear &= GetLastWordMask( numBits );
+		}
+		if( w == firstBit / BitsPerWord )
+		{
+			clear &= ~std::uint64_t( 0 ) << ( firstBit % BitsPerWord );
+		}
+		int count = PopCount( clear );
+		if( nth < count )
+		{
+			return w * BitsPerWord + SelectBit( clear, nth );
+		}
+		nth -= count;
+	}
+	return -1;
+}
+
+/// Forward iterator over indexes of the set bits, or clear bits, below numBits, ascending. One count trailing zeros per index.
+class BitIndexIterator
+{
+public:
+
+	BitIndexIterator( const std::uint64_t* words, int numBits, bool bClearBits, int wordIdx )
+		: m_words( words ), m_numBits( numBits ), m_wordIdx( wordIdx ), m_bClearBits( bClearBits )
+	{
+		if( m_wordIdx < GetNumWords( m_numBits ) )
+		{
+			m_word = LoadWord( m_wordIdx );
+			SkipEmptyWords();
+		}
+	}
+
+	int operator*() const { return m_wordIdx * BitsPerWord + CountTrailingZeros( m_word ); }
+
+	BitIndexIterator& operator++()
+	{
+		m_word &= m_word - 1;
+		SkipEmptyWords();
+		return *this;
+	}
+
+	bool operator==( const BitIndexIterator& other ) const { return m_wordIdx == other.m_wordIdx && m_word == other.m_word; }
+	bool operator!=( const BitIndexIterator& other ) const { return !( *this == other ); }
+
+private:
+
+	std::uint64_t LoadWord( int wordIdx ) const
+	{
+		std::uint64_t word = m_bClearBits ? ~m_words[ wordIdx ] : m_words[ wordIdx ];
+		return wordIdx == GetNumWords( m_numBits ) - 1 ? word & GetLastWordMask( m_numBits ) : word;
+	}
+
+	void SkipEmptyWords()
+	{
+		int numWords = GetNumWords( m_numBits );
+		while( m_word == 0 && ++m_wordIdx < numWords )
+		{
+			m_word = LoadWord( m_wordIdx );
+		}
+	}
+
+	const std::uint64_t* m_words;
+	int m_numBits;
+	int m_wordIdx;
+	std::uint64_t m_word = { 0 };
+	bool m_bClearBits;
+};
+
+/// Range of set or clear bit indexes, for range-based for.
+class BitIndexRange
+{
+public:
+
+	BitIndexRange( const std::uint64_t* words, int numBits, bool bClearBits ) : m_words( words ), m_numBits( numBits ), m_bClearBits( bClearBits ) {}
+
+	BitIndexIterator begin() const { return BitIndexIterator( m_words, m_numBits, m_bClearBits, 0 ); }
+	BitIndexIterator end() const { return BitIndexIterator( m_words, m_numBits, m_bClearBits, GetNumWords( m_numBits ) ); }
+
+private:
+
+	const std::uint64_t* m_words;
+	int m_numBits;
+	bool m_bClearBits;
+};
+
+/// Returns number of bits below numBits clear in both words and maskWords.
+inline int CountClearBits( const std::uint64_t* words, const std::uint64_t* maskWords, int numBits )
+{
+	int numWords = GetNumWords( numBits );
+	int count = 0;
+	for( int w = 0; w + 1 < numWords; ++w )
+	{
+		count += PopCount( ~( words[ w ] | maskWords[ w ] ) );
+	}
+	if( numWords > 0 )
+	{
+		count += PopCount( ~( words[ numWords - 1 ] | maskWords[ numWords - 1 ] ) & GetLastWordMask( numBits ) );
+	}
+	return count;
+}
+
+}
+}
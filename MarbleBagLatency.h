@@ -0,0 +1,399 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagLatency.h
+* Optional latency instrumentation for MarbleBag.
+* LatencyMarbleBagObserver records GetNext() and Reset() latency into log-linear (HDR-style)
+* histograms shared by every bag of the same type, and pushes draws slower than a threshold into
+* a lock-free flight recorder ring that can be dumped at any time. Recording is wait-free:
+* one relaxed atomic increment per histogram sample and one ticket increment per slow draw.
+*
+* Usage:
+*	using LootBag = MarbleBag< 100, std::default_random_engine, LatencyMarbleBagObserver< 100 > >;
+*	LootBag bag;
+*	bag.GetObserver().SetBagId( 42 );												// Id written into flight recorder entries
+*	LatencyMarbleBagObserver< 100 >::GetStats().SetSlowThresholdNanoseconds( 5000 );	// Record draws slower than 5us
+*	std::uint64_t p99 = LatencyMarbleBagObserver< 100 >::GetStats().getNextLatency.GetPercentile( 0.99 );
+*	LatencyMarbleBagObserver< 100 >::GetStats().slowDraws.Dump( stderr );			// Dump flight recorder on demand
+*
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+namespace crux
+{
+/// Log-linear histogram of nanosecond values. 16 sub-buckets per power of two, ~6% relative precision.
+class LatencyHistogram
+{
+public:
+
+	static const int SubBucketBits = 4;
+	static const int NumSubBuckets = 1 << SubBucketBits;
+	static const int NumBuckets = ( 64 - SubBucketBits + 1 ) * NumSubBuckets;
+
+	/// Constructor
+	LatencyHistogram();
+
+	/// No copy operations
+	LatencyHistogram( const LatencyHistogram& other ) = delete;
+	LatencyHistogram& operator=( const LatencyHistogram& other ) = delete;
+
+	/// Adds one sample. Safe to call concurrently.
+	void Record( std::uint64_t nanoseconds );
+
+	/// Returns number of recorded samples.
+	std::uint64_t GetCount() const;
+
+	/// Returns upper bound of the bucket holding the given percentile in [0, 1]. Returns 0 if empty.
+	std::uint64_t GetPercentile( double fraction ) const;
+
+	/// Returns upper bound of the highest non-empty bucket. Returns 0 if empty.
+	std::uint64_t GetMax() const;
+
+	/// Clears all samples. Samples recorded concurrently may survive.
+	void Reset();
+
+	/// Returns bucket holding value.
+	static int GetBucketIndex( std::uint64_t nanoseconds );
+
+	/// Returns smallest value held by bucket.
+	static std::uint64_t GetBucketLowerBound( int bucketIndex );
+
+	/// Returns largest value held by bucket.
+	static std::uint64_t GetBucketUpperBound( int bucketIndex );
+
+private:
+
+	std::array< std::atomic< std::uint64_t >, NumBuckets > m_counts;
+};
+
+/// One flight recorder entry.
+struct SlowDrawRecord
+{
+	std::uint64_t sequence;			// Monotonic index of the slow draw since start
+	std::uint32_t bagId;
+	std::int32_t numMarbles;
+	std::int32_t remainingCount;	// Remaining after the draw, 0 for an exhausted draw
+	std::uint64_t latencyNanoseconds;
+};
+
+/// Lock-free multi-producer ring of the most recent slow draws. Each slot is guarded by a sequence counter.
+template< std::size_t Capacity >
+class FlightRecorder
+{
+public:
+
+	static_assert( Capacity > 0 && ( Capacity & ( Capacity - 1 ) ) == 0, "FlightRecorder capacity must be a power of two" );
+
+	/// Constructor
+	FlightRecorder();
+
+	/// No copy operations
+	FlightRecorder( const FlightRecorder& other ) = delete;
+	FlightRecorder& operator=( const FlightRecorder& other ) = delete;
+
+	/// Appends entry, overwriting the oldest when full. Safe to call concurrently.
+	void Record( std::uint32_t bagId, int numMarbles, int remainingCount, std::uint64_t latencyNanoseconds );
+
+	/// Visits the retained entries oldest first. Entries overwritten while being read are skipped.
+	template< typename CallbackType >
+	void ForEach( CallbackType&& callback ) const;
+
+	/// Writes retained entries as text lines to file.
+	void Dump( std::FILE* file ) const;
+
+	/// Returns total number of entries ever recorded.
+	std::uint64_t GetTotalRecorded() const;
+
+private:
+
+	struct Slot
+	{
+		std::atomic< std::uint64_t > sequence;		// 2 * ( ticket + 1 ) when complete, odd while being written
+		std::atomic< std::uint32_t > bagId;
+		std::atomic< std::int32_t > numMarbles;
+		std::atomic< std::int32_t > remainingCount;
+		std::atomic< std::uint64_t > latencyNanoseconds;
+	};
+
+	std::array< Slot, Capacity > m_slots;
+	std::atomic< std::uint64_t > m_nextTicket;
+};
+
+/// Latency histograms and slow draw recorder shared by one bag type.
+template< std::size_t RecorderCapacity = 1024 >
+class MarbleBagLatencyStats
+{
+public:
+
+	/// Sets latency above which draws are written to slowDraws. Defaults to 10us.
+	void SetSlowThresholdNanoseconds( std::uint64_t nanoseconds ) { m_slowThresholdNanoseconds.store( nanoseconds, std::memory_order_relaxed ); }
+	std::uint64_t GetSlowThresholdNanoseconds() const { return m_slowThresholdNanoseconds.load( std::memory_order_relaxed ); }
+
+	/// Records one GetNext() call.
+	void RecordGetNext( std::uint32_t bagId, int numMarbles, int remainingCount, std::uint64_t nanoseconds )
+	{
+		getNextLatency.Record( nanoseconds );
+		if( nanoseconds > GetSlowThresholdNanoseconds() )
+		{
+			slowDraws.Record( bagId, numMarbles, remainingCount, nanoseconds );
+		}
+	}
+
+public:
+
+	LatencyHistogram getNextLatency;
+	LatencyHistogram resetLatency;
+	FlightRecorder< RecorderCapacity > slowDraws;
+
+private:
+
+	std::atomic< std::uint64_t > m_slowThresholdNanoseconds = { 10000 };
+};
+
+/// Observer timing GetNext() and Reset() into statistics shared by all bags with the same NumMarbles and TagType.
+template< int NumMarbles, typename TagType = void, std::size_t RecorderCapacity = 1024 >
+class LatencyMarbleBagObserver
+{
+public:
+
+	/// Returns statistics shared by this bag type.
+	static MarbleBagLatencyStats< RecorderCapacity >& GetStats()
+	{
+		static MarbleBagLatencyStats< RecorderCapacity > stats;
+		return stats;
+	}
+
+	/// Id written into flight recorder entries.
+	void SetBagId( std::uint32_t bagId ) { m_bagId = bagId; }
+	std::uint32_t GetBagId() const { return m_bagId; }
+
+	void OnGetNextBegin() { m_getNextStart = std::chrono::steady_clock::now(); }
+	void OnDraw( int /*value*/, int /*probeLength*/, int remainingCount ) { GetStats().RecordGetNext( m_bagId, NumMarbles, remainingCount, ElapsedSince( m_getNextStart ) ); }
+	void OnExhausted() { GetStats().RecordGetNext( m_bagId, NumMarbles, 0, ElapsedSince( m_getNextStart ) ); }
+	void OnReset( int /*numRemoved*/, int /*remainingCount*/ ) { m_resetStart = std::chrono::steady_clock::now(); }
+	void OnResetEnd() { GetStats().resetLatency.Record( ElapsedSince( m_resetStart ) ); }
+	void OnAutoReset() {}
+	void OnRollBegin() {}
+	void OnRollEnd() {}
+
+private:
+
+	static std::uint64_t ElapsedSince( std::chrono::steady_clock::time_point start )
+	{
+		return static_cast< std::uint64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - start ).count() );
+	}
+
+private:
+
+	std::chrono::steady_clock::time_point m_getNextStart;
+	std::chrono::steady_clock::time_point m_resetStart;
+	std::uint32_t m_bagId = { 0 };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// LatencyHistogram
+//
+
+inline LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+inline void LatencyHistogram::Record( std::uint64_t nanoseconds )
+{
+	m_counts[ GetBucketIndex( nanoseconds ) ].fetch_add( 1, std::memory_order_relaxed );
+}
+
+inline std::uint64_t LatencyHistogram::GetCount() const
+{
+	std::uint64_t total = 0;
+	for( const std::atomic< std::uint64_t >& count : m_counts )
+	{
+		total += count.load( std::memory_order_relaxed );
+	}
+	return total;
+}
+
+inline std::uint64_t LatencyHistogram::GetPercentile( double fraction ) const
+{
+	std::uint64_t total = GetCount();
+	if( total == 0 )
+	{
+		return 0;
+	}
+	std::uint64_t target = static_cast< std::uint64_t >( fraction * static_cast< double >( total ) );
+	target = target < 1 ? 1 : ( target > total ? total : target );
+	std::uint64_t seen = 0;
+	for( int i = 0; i < NumBuckets; ++i )
+	{
+		seen += m_counts[ i ].load( std::memory_order_relaxed );
+		if( seen >= target )
+		{
+			return GetBucketUpperBound( i );
+		}
+	}
+	return GetMax();
+}
+
+inline std::uint64_t LatencyHistogram::GetMax() const
+{
+	for( int i = NumBuckets - 1; i >= 0; --i )
+	{
+		if( m_counts[ i ].load( std::memory_order_relaxed ) != 0 )
+		{
+			return GetBucketUpperBound( i );
+		}
+	}
+	return 0;
+}
+
+inline void LatencyHistogram::Reset()
+{
+	for( std::atomic< std::uint64_t >& count : m_counts )
+	{
+		count.store( 0, std::memory_order_relaxed );
+	}
+}
+
+inline int LatencyHistogram::GetBucketIndex( std::uint64_t nanoseconds )
+{
+	if( nanoseconds < static_cast< std::uint64_t >( NumSubBuckets ) )
+	{
+		return static_cast< int >( nanoseconds );
+	}
+#if defined( __GNUC__ ) || defined( __clang__ )
+	int highestBit = 63 - __builtin_clzll( nanoseconds );
+#else
+	int highestBit = 0;
+	for( std::uint64_t bits = nanoseconds; bits > 1; bits >>= 1 )
+	{
+		++highestBit;
+	}
+#endif
+	int shift = highestBit - SubBucketBits;
+	return ( shift + 1 ) * NumSubBuckets + static_cast< int >( ( nanoseconds >> shift ) & ( NumSubBuckets - 1 ) );
+}
+
+inline std::uint64_t LatencyHistogram::GetBucketLowerBound( int bucketIndex )
+{
+	if( bucketIndex < NumSubBuckets )
+	{
+		return static_cast< std::uint64_t >( bucketIndex );
+	}
+	int shift = bucketIndex / NumSubBuckets - 1;
+	std::uint64_t subBucket = static_cast< std::uint64_t >( bucketIndex % NumSubBuckets );
+	return ( static_cast< std::uint64_t >( NumSubBuckets ) + subBucket ) << shift;
+}
+
+inline std::uint64_t LatencyHistogram::GetBucketUpperBound( int bucketIndex )
+{
+	return bucketIndex + 1 < NumBuckets ? GetBucketLowerBound( bucketIndex + 1 ) - 1 : ~static_cast< std::uint64_t >( 0 );
+}
+
+//
+// FlightRecorder
+//
+
+template< std::size_t Capacity >
+FlightRecorder< Capacity >::FlightRecorder()
+{
+	for( Slot& slot : m_slots )
+	{
+		slot.sequence.store( 0, std::memory_order_relaxed );
+	}
+	m_nextTicket.store( 0, std::memory_order_relaxed );
+}
+
+template< std::size_t Capacity >
+void FlightRecorder< Capacity >::Record( std::uint32_t bagId, int numMarbles, int remainingCount, std::uint64_t latencyNanoseconds )
+{
+	std::uint64_t ticket = m_nextTicket.fetch_add( 1, std::memory_order_relaxed );
+	Slot& slot = m_slots[ ticket & ( Capacity - 1 ) ];
+	slot.sequence.store( 2 * ticket + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	slot.bagId.store( bagId, std::memory_order_relaxed );
+	slot.numMarbles.store( numMarbles, std::memory_order_relaxed );
+	slot.remainingCount.store( remainingCount, std::memory_order_relaxed );
+	slot.latencyNanoseconds.store( latencyNanoseconds, std::memory_order_relaxed );
+	slot.sequence.store( 2 * ( ticket + 1 ), std::memory_order_release );
+}
+
+template< std::size_t Capacity >
+template< typename CallbackType >
+void FlightRecorder< Capacity >::ForEach( CallbackType&& callback ) const
+{
+	std::uint64_t end = m_nextTicket.load( std::memory_order_acquire );
+	std::uint64_t begin = end > Capacity ? end - Capacity : 0;
+	for( std::uint64_t ticket = begin; ticket < end; ++ticket )
+	{
+		const Slot& slot = m_slots[ ticket & ( Capacity - 1 ) ];
+		std::uint64_t sequence = slot.sequence.load( std::memory_order_acquire );
+		if( sequence != 2 * ( ticket + 1 ) )
+		{
+			continue;
+		}
+		SlowDrawRecord record;
+		record.sequence = ticket;
+		record.bagId = slot.bagId.load( std::memory_order_relaxed );
+		record.numMarbles = slot.numMarbles.load( std::memory_order_relaxed );
+		record.remainingCount = slot.remainingCount.load( std::memory_order_relaxed );
+		record.latencyNanoseconds = slot.latencyNanoseconds.load( std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( slot.sequence.load( std::memory_order_relaxed ) == sequence )
+		{
+			callback( record );
+		}
+	}
+}
+
+template< std::size_t Capacity >
+void FlightRecorder< Capacity >::Dump( std::FILE* file ) const
+{
+	ForEach( [ file ]( const SlowDrawRecord& record )
+	{
+		std::fprintf( file, "slow_draw seq=%llu bag=%u N=%d remaining=%d latency_ns=%llu\n",
+			static_cast< unsigned long long >( record.sequence ),
+			static_cast< unsigned >( record.bagId ),
+			static_cast< int >( record.numMarbles ),
+			static_cast< int >( record.remainingCount ),
+			static_cast< unsigned long long >( record.latencyNanoseconds ) );
+	} );
+}
+
+template< std::size_t Capacity >
+std::uint64_t FlightRecorder< Capacity >::GetTotalRecorded() const
+{
+	return m_nextTicket.load( std::memory_order_relaxed );
+}
+
+}
@@ -0,0 +1,484 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagMetrics.h
+* Per-table draw frequency and cycle statistics with Prometheus text export.
+* A MarbleBagTableStats counts per-value draws, completed cycles, mid-cycle resets and exhausted
+* draws for every bag pointed at it. Counts go to per-thread shards of relaxed atomics, so the
+* draw path takes no locks and threads rarely share cache lines. Tables register themselves with
+* MarbleBagMetricsRegistry, which sums shards on export. MarbleBagMetricsExporter writes the
+* registry periodically to a file or callback from a background thread.
+*
+* Usage:
+*	MarbleBagTableStats< 100 > lootStats( "loot_common" );							// Registers with MarbleBagMetricsRegistry::Get()
+*	MarbleBag< 100, std::default_random_engine, StatsMarbleBagObserver< 100 > > bag;
+*	bag.GetObserver().SetTableStats( &lootStats );									// Bag counts into lootStats
+*	MarbleBagMetricsExporter exporter( MarbleBagMetricsExporter::WriteFile( "/var/run/marblebag.prom" ), std::chrono::seconds( 15 ) );
+*	std::string text = MarbleBagMetricsRegistry::Get().FormatPrometheus();			// Export on demand
+*
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace crux
+{
+/// Totals of one table summed over all shards.
+struct MarbleBagStatsSnapshot
+{
+	std::string tableName;
+	std::vector< std::uint64_t > valueDraws;
+	std::uint64_t cyclesCompleted = { 0 };
+	std::uint64_t midCycleResets = { 0 };
+	std::uint64_t exhaustedDraws = { 0 };
+};
+
+/// Process wide list of tables for export. Registration locks, counting does not.
+class MarbleBagMetricsRegistry
+{
+public:
+
+	using SnapshotFunction = std::function< MarbleBagStatsSnapshot() >;
+
+	/// Returns process wide registry.
+	static MarbleBagMetricsRegistry& Get()
+	{
+		static MarbleBagMetricsRegistry registry;
+		return registry;
+	}
+
+	/// Adds table source. Returns id for Unregister().
+	std::uint64_t Register( SnapshotFunction snapshot );
+
+	/// Removes table source.
+	void Unregister( std::uint64_t id );
+
+	/// Returns snapshot of every registered table.
+	std::vector< MarbleBagStatsSnapshot > Snapshot() const;
+
+	/// Returns all tables in Prometheus text exposition format.
+	std::string FormatPrometheus() const;
+
+private:
+
+	mutable std::mutex m_mutex;
+	std::vector< std::pair< std::uint64_t, SnapshotFunction > > m_sources;
+	std::uint64_t m_nextId = { 1 };
+};
+
+/// Returns small index unique to the calling thread, used to pick a counter shard.
+inline unsigned GetMarbleBagThreadIndex()
+{
+	static std::atomic< unsigned > nextIndex = { 0 };
+	static thread_local unsigned index = nextIndex.fetch_add( 1, std::memory_order_relaxed );
+	return index;
+}
+
+/// Draw statistics of one table. Shards are allocated lazily per thread index and never freed before the table.
+template< int NumMarbles, int NumShards = 64 >
+class MarbleBagTableStats
+{
+public:
+
+	/// Constructor, registers with MarbleBagMetricsRegistry::Get()
+	explicit MarbleBagTableStats( std::string tableName );
+
+	/// Destructor, unregisters
+	~MarbleBagTableStats();
+
+	/// No copy operations
+	MarbleBagTableStats( const MarbleBagTableStats& other ) = delete;
+	MarbleBagTableStats& operator=( const MarbleBagTableStats& other ) = delete;
+
+	void CountDraw( int value, int remainingCount );
+	void CountReset( int numRemoved, int remainingCount );
+	void CountExhausted();
+
+	/// Returns totals summed over shards.
+	MarbleBagStatsSnapshot Snapshot() const;
+
+private:
+
+	struct Shard
+	{
+		std::array< std::atomic< std::uint64_t >, NumMarbles > valueDraws;
+		std::atomic< std::uint64_t > cyclesCompleted;
+		std::atomic< std::uint64_t > midCycleResets;
+		std::atomic< std::uint64_t > exhaustedDraws;
+
+		Shard();
+	};
+
+	Shard& GetShard();
+
+private:
+
+	std::string m_tableName;
+	std::array< std::atomic< Shard* >, NumShards > m_shards;
+	std::uint64_t m_registryId;
+};
+
+/// Observer counting into a MarbleBagTableStats. Counts nothing until SetTableStats() is called.
+template< int NumMarbles, int NumShards = 64 >
+class StatsMarbleBagObserver
+{
+public:
+
+	void SetTableStats( MarbleBagTableStats< NumMarbles, NumShards >* tableStats ) { m_tableStats = tableStats; }
+
+	void OnGetNextBegin() {}
+	void OnDraw( int value, int /*probeLength*/, int remainingCount ) { if( m_tableStats ) { m_tableStats->CountDraw( value, remainingCount ); } }
+	void OnReset( int numRemoved, int remainingCount ) { if( m_tableStats ) { m_tableStats->CountReset( numRemoved, remainingCount ); } }
+	void OnResetEnd() {}
+	void OnAutoReset() {}
+	void OnExhausted() { if( m_tableStats ) { m_tableStats->CountExhausted(); } }
+	void OnRollBegin() {}
+	void OnRollEnd() {}
+
+private:
+
+	MarbleBagTableStats< NumMarbles, NumShards >* m_tableStats = { nullptr };
+};
+
+/// Background thread exporting a registry at a fixed interval, plus once on destruction.
+class MarbleBagMetricsExporter
+{
+public:
+
+	using ExportFunction = std::function< void( const std::string& ) >;
+
+	/// Constructor, starts export thread
+	MarbleBagMetricsExporter( ExportFunction exportFunction, std::chrono::milliseconds interval, const MarbleBagMetricsRegistry& registry = MarbleBagMetricsRegistry::Get() );
+
+	/// Destructor, performs final export and joins thread
+	~MarbleBagMetricsExporter();
+
+	/// No copy operations
+	MarbleBagMetricsExporter( const MarbleBagMetricsExporter& other ) = delete;
+	MarbleBagMetricsExporter& operator=( const MarbleBagMetricsExporter& other ) = delete;
+
+	/// Returns export function replacing file at path through a temporary file and rename, so scrapers never read partial output.
+	static ExportFunction WriteFile( std::string path );
+
+private:
+
+	void Run();
+
+private:
+
+	ExportFunction m_exportFunction;
+	std::chrono::milliseconds m_interval;
+	const MarbleBagMetricsRegistry& m_registry;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	bool m_bStopping = { false };
+	std::thread m_thread;
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// MarbleBagMetricsRegistry
+//
+
+inline std::uint64_t MarbleBagMetricsRegistry::Register( SnapshotFunction snapshot )
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	std::uint64_t id = m_nextId++;
+	m_sources.emplace_back( id, std::move( snapshot ) );
+	return id;
+}
+
+inline void MarbleBagMetricsRegistry::Unregister( std::uint64_t id )
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	for( auto it = m_sources.begin(); it != m_sources.end(); ++it )
+	{
+		if( it->first == id )
+		{
+			m_sources.erase( it );
+			return;
+		}
+	}
+}
+
+inline std::vector< MarbleBagStatsSnapshot > MarbleBagMetricsRegistry::Snapshot() const
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	std::vector< MarbleBagStatsSnapshot > snapshots;
+	snapshots.reserve( m_sources.size() );
+	for( const auto& source : m_sources )
+	{
+		snapshots.push_back( source.second() );
+	}
+	return snapshots;
+}
+
+namespace detail
+{
+/// Returns value escaped for a Prometheus text format label: backslash, double quote and line feed.
+inline std::string EscapePrometheusLabel( const std::string& value )
+{
+	std::string escaped;
+	escaped.reserve( value.size() );
+	for( char c : value )
+	{
+		switch( c )
+		{
+		case '\\':	escaped += "\\\\"; break;
+		case '"':	escaped += "\\\""; break;
+		case '\n':	escaped += "\\n"; break;
+		default:	escaped += c; break;
+		}
+	}
+	return escaped;
+}
+}
+
+inline std::string MarbleBagMetricsRegistry::FormatPrometheus() const
+{
+	std::vector< MarbleBagStatsSnapshot > snapshots = Snapshot();
+	std::string text;
+	char line[ 512 ];
+
+	text += "# HELP marblebag_value_draws_total Marbles drawn per value.\n";
+	text += "# TYPE marblebag_value_draws_total counter\n";
+	std::vector< std::string > tableLabels;
+	tableLabels.reserve( snapshots.size() );
+	for( const MarbleBagStatsSnapshot& snapshot : snapshots )
+	{
+		tableLabels.push_back( "{table=\"" + detail::EscapePrometheusLabel( snapshot.tableName ) + "\"" );
+	}
+	for( std::size_t s = 0; s < snapshots.size(); ++s )
+	{
+		for( std::size_t value = 0; value < snapshots[ s ].valueDraws.size(); ++value )
+		{
+			std::snprintf( line, sizeof( line ), ",value=\"%zu\"} %llu\n", value, static_cast< unsigned long long >( snapshots[ s ].valueDraws[ value ] ) );
+			text += "marblebag_value_draws_total";
+			text += tableLabels[ s ];
+			text += line;
+		}
+	}
+
+	struct Family
+	{
+		const char* name;
+		const char* help;
+		std::uint64_t MarbleBagStatsSnapshot::* field;
+	};
+	const Family families[] =
+	{
+		{ "marblebag_cycles_completed_total", "Cycles in which every marble was drawn.", &MarbleBagStatsSnapshot::cyclesCompleted },
+		{ "marblebag_mid_cycle_resets_total", "Resets while marbles were both drawn and remaining.", &MarbleBagStatsSnapshot::midCycleResets },
+		{ "marblebag_exhausted_draws_total", "GetNext() calls returning -1.", &MarbleBagStatsSnapshot::exhaustedDraws },
+	};
+	for( const Family& family : families )
+	{
+		std::snprintf( line, sizeof( line ), "# HELP %s %s\n# TYPE %s counter\n", family.name, family.help, family.name );
+		text += line;
+		for( std::size_t s = 0; s < snapshots.size(); ++s )
+		{
+			std::snprintf( line, sizeof( line ), "} %llu\n", static_cast< unsigned long long >( snapshots[ s ].*family.field ) );
+			text += family.name;
+			text += tableLabels[ s ];
+			text += line;
+		}
+	}
+	return text;
+}
+
+//
+// MarbleBagTableStats
+//
+
+template< int NumMarbles, int NumShards >
+MarbleBagTableStats< NumMarbles, NumShards >::Shard::Shard()
+{
+	for( std::atomic< std::uint64_t >& count : valueDraws )
+	{
+		count.store( 0, std::memory_order_relaxed );
+	}
+	cyclesCompleted.store( 0, std::memory_order_relaxed );
+	midCycleResets.store( 0, std::memory_order_relaxed );
+	exhaustedDraws.store( 0, std::memory_order_relaxed );
+}
+
+template< int NumMarbles, int NumShards >
+MarbleBagTableStats< NumMarbles, NumShards >::MarbleBagTableStats( std::string tableName )
+	: m_tableName( std::move( tableName ) )
+{
+	for( std::atomic< Shard* >& shard : m_shards )
+	{
+		shard.store( nullptr, std::memory_order_relaxed );
+	}
+	m_registryId = MarbleBagMetricsRegistry::Get().Register( [ this ]() { return Snapshot(); } );
+}
+
+template< int NumMarbles, int NumShards >
+MarbleBagTableStats< NumMarbles, NumShards >::~MarbleBagTableStats()
+{
+	MarbleBagMetricsRegistry::Get().Unregister( m_registryId );
+	for( std::atomic< Shard* >& shard : m_shards )
+	{
+		delete shard.load( std::memory_order_acquire );
+	}
+}
+
+template< int NumMarbles, int NumShards >
+typename MarbleBagTableStats< NumMarbles, NumShards >::Shard& MarbleBagTableStats< NumMarbles, NumShards >::GetShard()
+{
+	std::atomic< Shard* >& slot = m_shards[ GetMarbleBagThreadIndex() % NumShards ];
+	Shard* shard = slot.load( std::memory_order_acquire );
+	if( shard == nullptr )
+	{
+		Shard* created = new Shard();
+		if( slot.compare_exchange_strong( shard, created, std::memory_order_acq_rel ) )
+		{
+			shard = created;
+		}
+		else
+		{
+			delete created;
+		}
+	}
+	return *shard;
+}
+
+template< int NumMarbles, int NumShards >
+void MarbleBagTableStats< NumMarbles, NumShards >::CountDraw( int value, int remainingCount )
+{
+	Shard& shard = GetShard();
+	shard.valueDraws[ value ].fetch_add( 1, std::memory_order_relaxed );
+	if( remainingCount == 0 )
+	{
+		shard.cyclesCompleted.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+template< int NumMarbles, int NumShards >
+void MarbleBagTableStats< NumMarbles, NumShards >::CountReset( int numRemoved, int remainingCount )
+{
+	if( numRemoved > 0 && remainingCount > 0 )
+	{
+		GetShard().midCycleResets.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+template< int NumMarbles, int NumShards >
+void MarbleBagTableStats< NumMarbles, NumShards >::CountExhausted()
+{
+	GetShard().exhaustedDraws.fetch_add( 1, std::memory_order_relaxed );
+}
+
+template< int NumMarbles, int NumShards >
+MarbleBagStatsSnapshot MarbleBagTableStats< NumMarbles, NumShards >::Snapshot() const
+{
+	MarbleBagStatsSnapshot snapshot;
+	snapshot.tableName = m_tableName;
+	snapshot.valueDraws.assign( NumMarbles, 0 );
+	for( const std::atomic< Shard* >& slot : m_shards )
+	{
+		const Shard* shard = slot.load( std::memory_order_acquire );
+		if( shard == nullptr )
+		{
+			continue;
+		}
+		for( int value = 0; value < NumMarbles; ++value )
+		{
+			snapshot.valueDraws[ value ] += shard->valueDraws[ value ].load( std::memory_order_relaxed );
+		}
+		snapshot.cyclesCompleted += shard->cyclesCompleted.load( std::memory_order_relaxed );
+		snapshot.midCycleResets += shard->midCycleResets.load( std::memory_order_relaxed );
+		snapshot.exhaustedDraws += shard->exhaustedDraws.load( std::memory_order_relaxed );
+	}
+	return snapshot;
+}
+
+//
+// MarbleBagMetricsExporter
+//
+
+inline MarbleBagMetricsExporter::MarbleBagMetricsExporter( ExportFunction exportFunction, std::chrono::milliseconds interval, const MarbleBagMetricsRegistry& registry )
+	: m_exportFunction( std::move( exportFunction ) )
+	, m_interval( interval )
+	, m_registry( registry )
+{
+	m_thread = std::thread( [ this ]() { Run(); } );
+}
+
+inline MarbleBagMetricsExporter::~MarbleBagMetricsExporter()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_bStopping = true;
+	}
+	m_wakeup.notify_one();
+	m_thread.join();
+}
+
+inline MarbleBagMetricsExporter::ExportFunction MarbleBagMetricsExporter::WriteFile( std::string path )
+{
+	return [ path ]( const std::string& text )
+	{
+		std::string temporaryPath = path + ".tmp";
+		if( std::FILE* file = std::fopen( temporaryPath.c_str(), "wb" ) )
+		{
+			bool bWritten = std::fwrite( text.data(), 1, text.size(), file ) == text.size();
+			bWritten = ( std::fclose( file ) == 0 ) && bWritten;
+			if( bWritten )
+			{
+				std::rename( temporaryPath.c_str(), path.c_str() );
+			}
+		}
+	};
+}
+
+inline void MarbleBagMetricsExporter::Run()
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+	while( true )
+	{
+		bool bStopping = m_wakeup.wait_for( lock, m_interval, [ this ]() { return m_bStopping; } );
+		lock.unlock();
+		m_exportFunction( m_registry.FormatPrometheus() );
+		lock.lock();
+		if( bStopping )
+		{
+			return;
+		}
+	}
+}
+
+}
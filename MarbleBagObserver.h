@@ -0,0 +1,159 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagObserver.h
+* Compile-time instrumentation hooks for MarbleBag.
+* An observer is the third MarbleBag template parameter and receives a callback for every
+* draw, reset, auto-reset, exhausted draw and Roll(). The default NullMarbleBagObserver has
+* empty inline callbacks and is an empty base of the bag, so it adds no size and no code.
+*
+* Callback order for one GetNext():
+*	OnGetNextBegin()
+*	OnAutoReset() + OnReset( numRemoved, remainingCount ) + OnResetEnd() when an empty bag auto resets, or OnExhausted() when it returns -1
+*	OnRollBegin(), OnRollEnd() around the random roll
+*	OnDraw( value, probeLength, remainingCount ) with the number of indexes the scan visited
+*
+* Reset() calls OnReset( numRemoved, remainingCount ) before and OnResetEnd() after clearing the bag.
+*
+* Usage:
+*	MarbleBag< 100, std::default_random_engine, CountingMarbleBagObserver<> > bag;	// Bag counting into thread local counters
+*	MarbleBagCounters& counters = GetThreadMarbleBagCounters();					// Counters for the calling thread
+*	counters = MarbleBagCounters{};												// Clear counters for the calling thread
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace crux
+{
+/// Default observer. Every callback is empty and optimizes away.
+class NullMarbleBagObserver
+{
+public:
+
+	void OnGetNextBegin() {}
+	void OnDraw( int /*value*/, int /*probeLength*/, int /*remainingCount*/ ) {}
+	void OnReset( int /*numRemoved*/, int /*remainingCount*/ ) {}
+	void OnResetEnd() {}
+	void OnAutoReset() {}
+	void OnExhausted() {}
+	void OnRollBegin() {}
+	void OnRollEnd() {}
+};
+
+/// Aggregated observer counts for one thread.
+struct MarbleBagCounters
+{
+	std::uint64_t numDraws = { 0 };
+	std::uint64_t numResets = { 0 };
+	std::uint64_t numMidCycleResets = { 0 };	// Resets while marbles were both removed and remaining
+	std::uint64_t numAutoResets = { 0 };
+	std::uint64_t numExhausted = { 0 };
+	std::uint64_t totalProbeLength = { 0 };
+	std::uint64_t maxProbeLength = { 0 };
+	std::uint64_t numTimedRolls = { 0 };
+	std::uint64_t totalRollNanoseconds = { 0 };
+};
+
+/// Returns counters of the calling thread, shared by all counting observers on this thread.
+inline MarbleBagCounters& GetThreadMarbleBagCounters()
+{
+	static thread_local MarbleBagCounters counters;
+	return counters;
+}
+
+namespace detail
+{
+/// Times Roll() into GetThreadMarbleBagCounters() with steady_clock.
+template< bool bTimeRolls >
+class RollTimer
+{
+protected:
+
+	void StartRoll() { m_rollStart = std::chrono::steady_clock::now(); }
+
+	void EndRoll()
+	{
+		MarbleBagCounters& counters = GetThreadMarbleBagCounters();
+		++counters.numTimedRolls;
+		counters.totalRollNanoseconds += static_cast< std::uint64_t >(
+			std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - m_rollStart ).count() );
+	}
+
+private:
+
+	std::chrono::steady_clock::time_point m_rollStart;
+};
+
+/// Roll timing compiled out, an empty base.
+template<>
+class RollTimer< false >
+{
+protected:
+
+	void StartRoll() {}
+	void EndRoll() {}
+};
+}
+
+/// Observer counting into GetThreadMarbleBagCounters(). Roll timing uses steady_clock and can be compiled out,
+/// in which case the observer is empty and adds no size to the bag.
+template< bool bTimeRolls = true >
+class CountingMarbleBagObserver : private detail::RollTimer< bTimeRolls >
+{
+public:
+
+	void OnGetNextBegin() {}
+
+	void OnDraw( int /*value*/, int probeLength, int /*remainingCount*/ )
+	{
+		MarbleBagCounters& counters = GetThreadMarbleBagCounters();
+		++counters.numDraws;
+		counters.totalProbeLength += static_cast< std::uint64_t >( probeLength );
+		counters.maxProbeLength = std::max( counters.maxProbeLength, static_cast< std::uint64_t >( probeLength ) );
+	}
+
+	void OnReset( int numRemoved, int remainingCount )
+	{
+		MarbleBagCounters& counters = GetThreadMarbleBagCounters();
+		++counters.numResets;
+		if( numRemoved > 0 && remainingCount > 0 )
+		{
+			++counters.numMidCycleResets;
+		}
+	}
+
+	void OnResetEnd() {}
+
+	void OnAutoReset() { ++GetThreadMarbleBagCounters().numAutoResets; }
+
+	void OnExhausted() { ++GetThreadMarbleBagCounters().numExhausted; }
+
+	void OnRollBegin() { this->StartRoll(); }
+
+	void OnRollEnd() { this->EndRoll(); }
+};
+
+}
@@ -0,0 +1,209 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagParallel.h
+* Helpers for driving many independent bags across cores.
+* DeriveSeed() maps ( master seed, index ) to a well mixed seed with splitmix64, so results depend
+* only on the master seed and never on thread count or scheduling. SplitMix64 is a random engine with
+* a full 64-bit seed that is free to seed, so every derived seed starts a distinct stream. ParallelFor()
+* splits an index range into chunks; each worker owns a contiguous chunk range and takes chunks from its
+* front, and idle workers steal the back half of the largest remaining range of another worker.
+*
+* Usage:
+*	std::uint64_t seed = DeriveSeed( masterSeed, sessionIndex );						// Independent seed per session
+*	DynamicMarbleBag< SplitMix64 > bag( 100, SplitMix64{ seed } );						// One of 2^64 streams
+*	ParallelFor( numSessions, numThreads, 4096, []( std::uint64_t begin, std::uint64_t end, unsigned threadIndex ) { ... } );
+*	ParallelForEach( bags.data(), bags.size(), numThreads, 4096, []( auto& bag ) { bag.Resize( 120 ); } );	// Same, one call per element
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace crux
+{
+/// Returns splitmix64 mix of masterSeed and index.
+inline std::uint64_t DeriveSeed( std::uint64_t masterSeed, std::uint64_t index )
+{
+	std::uint64_t z = masterSeed + ( index + 1 ) * 0x9e3779b97f4a7c15ull;
+	z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+	z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebull;
+	return z ^ ( z >> 31 );
+}
+
+/// splitmix64 random engine, 64-bit state and seed.
+class SplitMix64
+{
+public:
+
+	typedef std::uint64_t result_type;
+
+	explicit SplitMix64( std::uint64_t seed = 0 ) : m_state( seed ) {}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type( 0 ); }
+
+	result_type operator()()
+	{
+		std::uint64_t z = ( m_state += 0x9e3779b97f4a7c15ull );
+		z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+		z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebull;
+		return z ^ ( z >> 31 );
+	}
+
+private:
+
+	std::uint64_t m_state;
+};
+
+/// Returns default worker count, at least 1.
+inline unsigned GetDefaultThreadCount()
+{
+	return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+/// Calls body( begin, end, threadIndex ) over disjoint subranges covering [0, numItems) on numThreads threads, with work stealing.
+template< typename BodyType >
+void ParallelFor( std::uint64_t numItems, unsigned numThreads, std::uint64_t grainSize, BodyType&& body )
+{
+	grainSize = std::max< std::uint64_t >( grainSize, 1 );
+	std::uint64_t numChunks = ( numItems + grainSize - 1 ) / grainSize;
+	if( numChunks == 0 )
+	{
+		return;
+	}
+	// Chunk ranges are packed as ( begin << 32 ) | end, so one worker's range is a single CAS target.
+	while( numChunks > 0xffffffffull )
+	{
+		grainSize *= 2;
+		numChunks = ( numItems + grainSize - 1 ) / grainSize;
+	}
+	numThreads = static_cast< unsigned >( std::max< std::uint64_t >( 1, std::min< std::uint64_t >( numThreads, numChunks ) ) );
+	if( numThreads == 1 )
+	{
+		body( std::uint64_t( 0 ), numItems, 0u );
+		return;
+	}
+
+	std::unique_ptr< std::atomic< std::uint64_t >[] > ranges( new std::atomic< std::uint64_t >[ numThreads ] );
+	for( unsigned t = 0; t < numThreads; ++t )
+	{
+		std::uint64_t begin = numChunks * t / numThreads;
+		std::uint64_t end = numChunks * ( t + 1 ) / numThreads;
+		ranges[ t ].store( ( begin << 32 ) | end, std::memory_order_relaxed );
+	}
+
+	auto runChunk = [ & ]( std::uint64_t chunk, unsigned threadIndex )
+	{
+		std::uint64_t begin = chunk * grainSize;
+		body( begin, std::min( begin + grainSize, numItems ), threadIndex );
+	};
+
+	auto worker = [ & ]( unsigned threadIndex )
+	{
+		std::atomic< std::uint64_t >& own = ranges[ threadIndex ];
+		while( true )
+		{
+			// Pop from the front of the own range.
+			std::uint64_t packed = own.load( std::memory_order_acquire );
+			while( ( packed >> 32 ) < ( packed & 0xffffffffull ) )
+			{
+				std::uint64_t chunk = packed >> 32;
+				if( own.compare_exchange_weak( packed, ( ( chunk + 1 ) << 32 ) | ( packed & 0xffffffffull ), std::memory_order_acq_rel ) )
+				{
+					runChunk( chunk, threadIndex );
+					packed = own.load( std::memory_order_acquire );
+				}
+			}
+
+			// Steal the back half of the largest remaining range, rescanning if its owner or another thief changed it meanwhile.
+			bool bStole = false;
+			while( !bStole )
+			{
+				unsigned victimIndex = threadIndex;
+				std::uint64_t victimPacked = 0;
+				std::uint64_t largestSize = 1;
+				for( unsigned offset = 1; offset < numThreads; ++offset )
+				{
+					unsigned index = ( threadIndex + offset ) % numThreads;
+					std::uint64_t candidatePacked = ranges[ index ].load( std::memory_order_acquire );
+					std::uint64_t candidateBegin = candidatePacked >> 32;
+					std::uint64_t candidateEnd = candidatePacked & 0xffffffffull;
+					if( candidateEnd > candidateBegin && candidateEnd - candidateBegin > largestSize )
+					{
+						victimIndex = index;
+						victimPacked = candidatePacked;
+						largestSize = candidateEnd - candidateBegin;
+					}
+				}
+				if( victimIndex == threadIndex )
+				{
+					break;
+				}
+				std::uint64_t begin = victimPacked >> 32;
+				std::uint64_t end = victimPacked & 0xffffffffull;
+				std::uint64_t middle = begin + ( end - begin ) / 2;
+				if( ranges[ victimIndex ].compare_exchange_strong( victimPacked, ( begin << 32 ) | middle, std::memory_order_acq_rel ) )
+				{
+					own.store( ( middle << 32 ) | end, std::memory_order_release );
+					bStole = true;
+				}
+			}
+			if( !bStole )
+			{
+				// Single chunks left elsewhere are finished by their owners.
+				return;
+			}
+		}
+	};
+
+	std::vector< std::thread > threads;
+	for( unsigned t = 1; t < numThreads; ++t )
+	{
+		threads.emplace_back( worker, t );
+	}
+	worker( 0 );
+	for( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+}
+
+/// Calls function( items[ i ] ) for every i in [0, numItems) with ParallelFor().
+template< typename ItemType, typename FunctionType >
+void ParallelForEach( ItemType* items, std::uint64_t numItems, unsigned numThreads, std::uint64_t grainSize, FunctionType&& function )
+{
+	ParallelFor( numItems, numThreads, grainSize, [ & ]( std::uint64_t begin, std::uint64_t end, unsigned )
+	{
+		for( std::uint64_t i = begin; i < end; ++i )
+		{
+			function( items[ i ] );
+		}
+	} );
+}
+
+}
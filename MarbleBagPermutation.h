@@ -0,0 +1,155 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagPermutation.h
+* Keyed bijection on [0, numValues) computed per index, with no per-value state beyond a 64 byte table.
+* Up to 64 values the permutation is that table, filled by a Fisher-Yates shuffle driven by splitmix64 of
+* the key, so every ordering is equally likely over random keys. Above that, a balanced twelve round Feistel
+* network over the smallest even bit width covering numValues, with splitmix64 as round function, maps
+* indexes to a permutation of that power of two; results outside [0, numValues) are fed back in (cycle
+* walking) until they land inside. Fewer rounds leave measurable position x value bias on small domains.
+* The covering domain is under four times numValues, so an index costs a few Feistel evaluations on average.
+* Walking indexes 0, 1, 2, ... visits every value exactly once in a key dependent order, which gives a bag
+* cycle in O(1) memory.
+*
+* Usage:
+*	KeyedPermutation permutation( 1000000, seed );									// Bijection on [0, 999999]
+*	std::uint64_t value = permutation( index );										// index-th value of the cycle
+*
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace crux
+{
+/// Stateless keyed permutation of [0, numValues).
+class KeyedPermutation
+{
+public:
+
+	KeyedPermutation() = default;
+
+	/// Permutation of [0, numValues) selected by key. numValues must be at most 2^62.
+	KeyedPermutation( std::uint64_t numValues, std::uint64_t key );
+
+	/// Returns value at position index of the permutation, index must be below GetNumValues().
+	std::uint64_t operator()( std::uint64_t index ) const;
+
+	/// Returns size of the permuted range.
+	std::uint64_t GetNumValues() const { return m_numValues; }
+
+private:
+
+	static std::uint64_t Mix( std::uint64_t value );
+
+	std::uint64_t Encrypt( std::uint64_t value ) const;
+
+private:
+
+	static const int NumRounds = 12;
+	static const int MaxTableValues = 64;
+
+	std::uint64_t m_roundKeys[ NumRounds ] = {};
+	std::uint8_t m_table[ MaxTableValues ] = {};
+	std::uint64_t m_numValues = { 0 };
+	std::uint64_t m_halfMask = { 0 };
+	int m_halfBits = { 1 };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+inline KeyedPermutation::KeyedPermutation( std::uint64_t numValues, std::uint64_t key )
+	: m_numValues( numValues )
+{
+	while( m_halfBits < 31 && ( std::uint64_t( 1 ) << ( 2 * m_halfBits ) ) < numValues )
+	{
+		++m_halfBits;
+	}
+	m_halfMask = ( std::uint64_t( 1 ) << m_halfBits ) - 1;
+	if( numValues <= MaxTableValues )
+	{
+		// Fisher-Yates with rejection, so each swap index is exactly uniform.
+		std::uint64_t counter = key;
+		for( std::uint64_t i = 0; i < numValues; ++i )
+		{
+			m_table[ i ] = static_cast< std::uint8_t >( i );
+		}
+		for( std::uint64_t i = numValues; i > 1; --i )
+		{
+			std::uint64_t limit = ~std::uint64_t( 0 ) - ~std::uint64_t( 0 ) % i;
+			std::uint64_t random = Mix( counter++ );
+			while( random >= limit )
+			{
+				random = Mix( counter++ );
+			}
+			std::uint8_t swapped = m_table[ i - 1 ];
+			m_table[ i - 1 ] = m_table[ random % i ];
+			m_table[ random % i ] = swapped;
+		}
+		return;
+	}
+	for( int round = 0; round < NumRounds; ++round )
+	{
+		key = Mix( key + round );
+		m_roundKeys[ round ] = key;
+	}
+}
+
+inline std::uint64_t KeyedPermutation::operator()( std::uint64_t index ) const
+{
+	if( m_numValues <= MaxTableValues )
+	{
+		return m_table[ index ];
+	}
+	std::uint64_t value = Encrypt( index );
+	while( value >= m_numValues )
+	{
+		value = Encrypt( value );
+	}
+	return value;
+}
+
+inline std::uint64_t KeyedPermutation::Mix( std::uint64_t value )
+{
+	value += 0x9e3779b97f4a7c15ull;
+	value = ( value ^ ( value >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+	value = ( value ^ ( value >> 27 ) ) * 0x94d049bb133111ebull;
+	return value ^ ( value >> 31 );
+}
+
+inline std::uint64_t KeyedPermutation::Encrypt( std::uint64_t value ) const
+{
+	std::uint64_t left = value >> m_halfBits;
+	std::uint64_t right = value & m_halfMask;
+	for( int round = 0; round < NumRounds; ++round )
+	{
+		std::uint64_t mixed = left ^ ( Mix( right ^ m_roundKeys[ round ] ) & m_halfMask );
+		left = right;
+		right = mixed;
+	}
+	return ( left << m_halfBits ) | right;
+}
+
+}
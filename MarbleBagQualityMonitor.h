@@ -0,0 +1,287 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagQualityMonitor.h
+* Streaming check that MarbleBag cycles are uniformly random permutations.
+* Every completed cycle adds one count per (position, value) cell of an N x N table. For uniform
+* permutations each cell expects cycles / N. Every EvaluationInterval cycles the table is tested with
+* Pearson's chi-square scaled by ( N - 1 ) / N on ( N - 1 )^2 degrees of freedom; each cycle fills every
+* row and column once, which inflates the plain statistic by N / ( N - 1 ). An alert callback fires when the
+* p-value drops below the configured threshold. Cycles cut short by a mid-cycle Reset() are dropped.
+*
+* Cost is one buffered int per draw, N relaxed increments per completed cycle and an O( N^2 )
+* evaluation every EvaluationInterval cycles. The table holds N^2 32-bit counters.
+*
+* Usage:
+*	PermutationQualityMonitor< 100 > monitor( 1e-6, 1000 );							// Alert below p = 1e-6, evaluate every 1000 cycles
+*	monitor.SetAlertCallback( []( const PermutationQualityReport& report ) { ... } );
+*	MarbleBag< 100, std::default_random_engine, QualityMonitorMarbleBagObserver< 100 > > bag;
+*	bag.GetObserver().SetMonitor( &monitor );										// Bag feeds completed cycles to monitor
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace crux
+{
+/// Result of one chi-square evaluation.
+struct PermutationQualityReport
+{
+	std::uint64_t numCycles = { 0 };
+	double chiSquare = { 0.0 };
+	double degreesOfFreedom = { 0.0 };
+	double pValue = { 1.0 };
+};
+
+/// Returns upper regularized incomplete gamma function Q( a, x ), the chi-square survival function at Q( dof / 2, chiSquare / 2 ).
+inline double UpperRegularizedGamma( double a, double x )
+{
+	if( x <= 0.0 )
+	{
+		return 1.0;
+	}
+	const int maxIterations = 1000;
+	const double epsilon = 1e-14;
+	double logPrefix = a * std::log( x ) - x - std::lgamma( a );
+	if( x < a + 1.0 )
+	{
+		// Series for P( a, x )
+		double term = 1.0 / a;
+		double sum = term;
+		for( int n = 1; n < maxIterations; ++n )
+		{
+			term *= x / ( a + n );
+			sum += term;
+			if( std::fabs( term ) < std::fabs( sum ) * epsilon )
+			{
+				break;
+			}
+		}
+		return std::max( 0.0, 1.0 - sum * std::exp( logPrefix ) );
+	}
+	// Lentz continued fraction for Q( a, x )
+	const double tiny = 1e-300;
+	double b = x + 1.0 - a;
+	double c = 1.0 / tiny;
+	double d = 1.0 / b;
+	double h = d;
+	for( int n = 1; n < maxIterations; ++n )
+	{
+		double an = -n * ( n - a );
+		b += 2.0;
+		d = an * d + b;
+		d = std::fabs( d ) < tiny ? tiny : d;
+		c = b + an / c;
+		c = std::fabs( c ) < tiny ? tiny : c;
+		d = 1.0 / d;
+		double delta = d * c;
+		h *= delta;
+		if( std::fabs( delta - 1.0 ) < epsilon )
+		{
+			break;
+		}
+	}
+	return std::exp( logPrefix ) * h;
+}
+
+/// Position x value frequency table of completed cycles with periodic chi-square evaluation. Thread safe.
+template< int NumMarbles >
+class PermutationQualityMonitor
+{
+public:
+
+	using AlertCallback = std::function< void( const PermutationQualityReport& ) >;
+
+	/// Constructor with alert threshold on the p-value and number of cycles between evaluations
+	PermutationQualityMonitor( double alertPValue = 1e-6, std::uint64_t evaluationInterval = 1000 );
+
+	/// No copy operations
+	PermutationQualityMonitor( const PermutationQualityMonitor& other ) = delete;
+	PermutationQualityMonitor& operator=( const PermutationQualityMonitor& other ) = delete;
+
+	/// Callback invoked on the thread completing the evaluated cycle whenever pValue < alertPValue.
+	void SetAlertCallback( AlertCallback callback );
+
+	/// Adds one full cycle, cycleValues[ position ] being the value drawn at that position.
+	void AddCycle( const int* cycleValues );
+
+	/// Computes chi-square statistic over all cycles added so far.
+	PermutationQualityReport Evaluate() const;
+
+	/// Returns report of the most recent periodic evaluation.
+	PermutationQualityReport GetLastReport() const;
+
+	/// Clears all counts.
+	void ResetStatistics();
+
+private:
+
+	void EvaluateAndAlert();
+
+private:
+
+	std::unique_ptr< std::atomic< std::uint32_t >[] > m_cellCounts;		// [ position * NumMarbles + value ]
+	std::atomic< std::uint64_t > m_numCycles;
+	double m_alertPValue;
+	std::uint64_t m_evaluationInterval;
+	mutable std::mutex m_reportMutex;
+	AlertCallback m_alertCallback;
+	PermutationQualityReport m_lastReport;
+};
+
+/// Observer buffering one bag's current cycle and handing completed cycles to a PermutationQualityMonitor.
+template< int NumMarbles >
+class QualityMonitorMarbleBagObserver
+{
+public:
+
+	void SetMonitor( PermutationQualityMonitor< NumMarbles >* monitor ) { m_monitor = monitor; m_position = 0; }
+
+	void OnGetNextBegin() {}
+	void OnDraw( int value, int /*probeLength*/, int /*remainingCount*/ )
+	{
+		m_cycleValues[ m_position++ ] = value;
+		if( m_position == NumMarbles )
+		{
+			if( m_monitor )
+			{
+				m_monitor->AddCycle( m_cycleValues.data() );
+			}
+			m_position = 0;
+		}
+	}
+	void OnReset( int /*numRemoved*/, int /*remainingCount*/ ) { m_position = 0; }
+	void OnResetEnd() {}
+	void OnAutoReset() {}
+	void OnExhausted() {}
+	void OnRollBegin() {}
+	void OnRollEnd() {}
+
+private:
+
+	PermutationQualityMonitor< NumMarbles >* m_monitor = { nullptr };
+	std::array< int, NumMarbles > m_cycleValues;
+	int m_position = { 0 };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+template< int NumMarbles >
+PermutationQualityMonitor< NumMarbles >::PermutationQualityMonitor( double alertPValue, std::uint64_t evaluationInterval )
+	: m_cellCounts( new std::atomic< std::uint32_t >[ static_cast< std::size_t >( NumMarbles ) * NumMarbles ] )
+	, m_alertPValue( alertPValue )
+	, m_evaluationInterval( std::max< std::uint64_t >( evaluationInterval, 1 ) )
+{
+	ResetStatistics();
+}
+
+template< int NumMarbles >
+void PermutationQualityMonitor< NumMarbles >::SetAlertCallback( AlertCallback callback )
+{
+	std::lock_guard< std::mutex > lock( m_reportMutex );
+	m_alertCallback = std::move( callback );
+}
+
+template< int NumMarbles >
+void PermutationQualityMonitor< NumMarbles >::AddCycle( const int* cycleValues )
+{
+	for( int position = 0; position < NumMarbles; ++position )
+	{
+		m_cellCounts[ position * NumMarbles + cycleValues[ position ] ].fetch_add( 1, std::memory_order_relaxed );
+	}
+	std::uint64_t numCycles = m_numCycles.fetch_add( 1, std::memory_order_acq_rel ) + 1;
+	if( numCycles % m_evaluationInterval == 0 )
+	{
+		EvaluateAndAlert();
+	}
+}
+
+template< int NumMarbles >
+PermutationQualityReport PermutationQualityMonitor< NumMarbles >::Evaluate() const
+{
+	PermutationQualityReport report;
+	report.numCycles = m_numCycles.load( std::memory_order_acquire );
+	if( NumMarbles < 2 || report.numCycles == 0 )
+	{
+		return report;
+	}
+	// Counts added concurrently may make row totals differ slightly from numCycles. Use the observed grand total.
+	std::uint64_t total = 0;
+	for( std::size_t cell = 0; cell < static_cast< std::size_t >( NumMarbles ) * NumMarbles; ++cell )
+	{
+		total += m_cellCounts[ cell ].load( std::memory_order_relaxed );
+	}
+	double expected = static_cast< double >( total ) / ( static_cast< double >( NumMarbles ) * NumMarbles );
+	double chiSquare = 0.0;
+	for( std::size_t cell = 0; cell < static_cast< std::size_t >( NumMarbles ) * NumMarbles; ++cell )
+	{
+		double difference = static_cast< double >( m_cellCounts[ cell ].load( std::memory_order_relaxed ) ) - expected;
+		chiSquare += difference * difference;
+	}
+	// A permutation's cell counts have variance expected * ( N - 1 ) / N instead of expected, scale back to chi-square on ( N - 1 )^2 dof.
+	report.chiSquare = chiSquare / expected * ( NumMarbles - 1 ) / NumMarbles;
+	report.degreesOfFreedom = static_cast< double >( NumMarbles - 1 ) * ( NumMarbles - 1 );
+	report.pValue = UpperRegularizedGamma( report.degreesOfFreedom * 0.5, report.chiSquare * 0.5 );
+	return report;
+}
+
+template< int NumMarbles >
+PermutationQualityReport PermutationQualityMonitor< NumMarbles >::GetLastReport() const
+{
+	std::lock_guard< std::mutex > lock( m_reportMutex );
+	return m_lastReport;
+}
+
+template< int NumMarbles >
+void PermutationQualityMonitor< NumMarbles >::ResetStatistics()
+{
+	for( std::size_t cell = 0; cell < static_cast< std::size_t >( NumMarbles ) * NumMarbles; ++cell )
+	{
+		m_cellCounts[ cell ].store( 0, std::memory_order_relaxed );
+	}
+	m_numCycles.store( 0, std::memory_order_release );
+}
+
+template< int NumMarbles >
+void PermutationQualityMonitor< NumMarbles >::EvaluateAndAlert()
+{
+	PermutationQualityReport report = Evaluate();
+	std::lock_guard< std::mutex > lock( m_reportMutex );
+	m_lastReport = report;
+	if( report.pValue < m_alertPValue && m_alertCallback )
+	{
+		m_alertCallback( report );
+	}
+}
+
+}
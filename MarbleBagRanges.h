@@ -0,0 +1,304 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagRanges.h
+* C++20 range adaptors over bags.
+* Shuffled( items, seed ) is a lazy view visiting every element of a random access range exactly once in
+* a seed dependent order. It stores only the underlying view and a KeyedPermutation, so it never allocates.
+* MarbleBagStream( bag ) is an input range of a bag's draws, refilled 64 at a time through the bag's batch
+* GetNext(); it ends only when a bag without bAutoReset runs out. GenerateMarbles( bag ) is the same stream as
+* a coroutine Generator, where the compiler supports coroutines. Both buffered sources draw up to 63 values
+* ahead of the consumer, so the bag is further along than the values consumed so far.
+* A stream holds its buffer inline and is not a view, so stream | views::take( k ) refers to the stream
+* instead of copying it: consecutive take()s on the same stream continue where the previous one stopped, and
+* nothing is allocated. Values buffered but not read when a stream is destroyed are lost to the consumer:
+* keep one stream per bag alive rather than creating temporaries per read.
+* Works with MarbleBag, DynamicMarbleBag and WeightedMarbleBag.
+*
+* Usage:
+*	for( Item& item : Shuffled( items, seed ) ) { ... }								// Each item once, random order
+*	auto stream = MarbleBagStream( bag );
+*	for( int value : stream | std::views::take( 1000 ) ) { ... }					// Next 1000 draws, a later take() continues after them
+*	for( int value : GenerateMarbles( bag ) ) { ... }								// Coroutine source
+*
+*/
+
+#pragma once
+
+#if __cplusplus < 202002L && !( defined( _MSVC_LANG ) && _MSVC_LANG >= 202002L )
+#error "MarbleBagRanges.h requires C++20"
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <utility>
+
+#if defined( __cpp_impl_coroutine )
+#include <coroutine>
+#include <exception>
+#endif
+
+#include "MarbleBagPermutation.h"
+
+namespace crux
+{
+/// View of a random access range in a keyed random order.
+template< std::ranges::view ViewType >
+	requires std::ranges::random_access_range< ViewType > && std::ranges::sized_range< ViewType >
+class ShuffledView : public std::ranges::view_interface< ShuffledView< ViewType > >
+{
+public:
+
+	class Iterator
+	{
+	public:
+
+		using value_type = std::ranges::range_value_t< ViewType >;
+		using difference_type = std::ptrdiff_t;
+		using iterator_concept = std::forward_iterator_tag;
+
+		Iterator() = default;
+		Iterator( ShuffledView* view, std::uint64_t index ) : m_view( view ), m_index( index ) {}
+
+		std::ranges::range_reference_t< ViewType > operator*() const
+		{
+			return std::ranges::begin( m_view->m_base )[ static_cast< std::ranges::range_difference_t< ViewType > >( m_view->m_permutation( m_index ) ) ];
+		}
+
+		Iterator& operator++() { ++m_index; return *this; }
+		Iterator operator++( int ) { Iterator previous = *this; ++m_index; return previous; }
+		bool operator==( const Iterator& other ) const = default;
+
+	private:
+
+		ShuffledView* m_view = { nullptr };
+		std::uint64_t m_index = { 0 };
+	};
+
+	ShuffledView() = default;
+	ShuffledView( ViewType base, std::uint64_t seed )
+		: m_base( std::move( base ) )
+		, m_permutation( static_cast< std::uint64_t >( std::ranges::size( m_base ) ), seed )
+	{}
+
+	Iterator begin() { return Iterator( this, 0 ); }
+	Iterator end() { return Iterator( this, m_permutation.GetNumValues() ); }
+	std::uint64_t size() const { return m_permutation.GetNumValues(); }
+
+private:
+
+	ViewType m_base;
+	KeyedPermutation m_permutation;
+};
+
+/// Returns view visiting every element of items once in an order chosen by seed.
+template< std::ranges::viewable_range RangeType >
+ShuffledView< std::views::all_t< RangeType > > Shuffled( RangeType&& items, std::uint64_t seed )
+{
+	return ShuffledView< std::views::all_t< RangeType > >( std::views::all( std::forward< RangeType >( items ) ), seed );
+}
+
+/// Input range of a bag's draws, buffered through batch GetNext(). Not a view: adaptors refer to it rather than copy it.
+template< typename BagType >
+class MarbleBagStreamRange
+{
+public:
+
+	static const int BatchSize = 64;
+
+	class Iterator
+	{
+	public:
+
+		using value_type = int;
+		using difference_type = std::ptrdiff_t;
+		using iterator_concept = std::input_iterator_tag;
+
+		Iterator() = default;
+		explicit Iterator( MarbleBagStreamRange* stream ) : m_stream( stream ) {}
+
+		int operator*() const { return m_stream->m_buffer[ m_stream->m_position ]; }
+
+		Iterator& operator++()
+		{
+			if( ++m_stream->m_position == m_stream->m_numBuffered && m_stream->m_numBuffered == BatchSize )
+			{
+				m_stream->Refill();
+			}
+			return *this;
+		}
+		void operator++( int ) { ++*this; }
+
+		bool operator==( std::default_sentinel_t ) const { return m_stream->m_position >= m_stream->m_numBuffered; }
+
+	private:
+
+		MarbleBagStreamRange* m_stream = { nullptr };
+	};
+
+	MarbleBagStreamRange() = default;
+	explicit MarbleBagStreamRange( BagType& bag ) : m_bag( &bag ) {}
+
+	/// No copy operations, a copy would read the bag independently of the original
+	MarbleBagStreamRange( const MarbleBagStreamRange< BagType >& other ) = delete;
+	MarbleBagStreamRange& operator=( const MarbleBagStreamRange< BagType >& other ) = delete;
+
+	/// Move operations
+	MarbleBagStreamRange( MarbleBagStreamRange< BagType >&& other ) = default;
+	MarbleBagStreamRange& operator=( MarbleBagStreamRange< BagType >&& other ) = default;
+
+	/// Returns iterator at the next unread draw. A default constructed stream is empty.
+	Iterator begin()
+	{
+		if( m_bag != nullptr && m_position == m_numBuffered )
+		{
+			Refill();
+		}
+		return Iterator( this );
+	}
+	std::default_sentinel_t end() const { return std::default_sentinel; }
+
+private:
+
+	void Refill()
+	{
+		m_numBuffered = m_bag->GetNext( m_buffer.data(), BatchSize );
+		m_position = 0;
+	}
+
+	BagType* m_bag = { nullptr };
+	std::array< int, BatchSize > m_buffer = {};
+	int m_numBuffered = { 0 };
+	int m_position = { 0 };
+};
+
+/// Returns input range of bag's draws. The bag must outlive the stream; iterators refer to the stream, so do not move it while iterating.
+template< typename BagType >
+MarbleBagStreamRange< BagType > MarbleBagStream( BagType& bag )
+{
+	return MarbleBagStreamRange< BagType >( bag );
+}
+
+#if defined( __cpp_impl_coroutine )
+
+/// Minimal move-only coroutine generator, an input range over the yielded values.
+template< typename ValueType >
+class Generator : public std::ranges::view_base
+{
+public:
+
+	struct promise_type
+	{
+		const ValueType* current = { nullptr };
+
+		Generator get_return_object() { return Generator( std::coroutine_handle< promise_type >::from_promise( *this ) ); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value( const ValueType& value ) noexcept { current = std::addressof( value ); return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	class Iterator
+	{
+	public:
+
+		using value_type = ValueType;
+		using difference_type = std::ptrdiff_t;
+		using iterator_concept = std::input_iterator_tag;
+
+		Iterator() = default;
+		explicit Iterator( std::coroutine_handle< promise_type > coroutine ) : m_coroutine( coroutine ) {}
+
+		const ValueType& operator*() const { return *m_coroutine.promise().current; }
+		Iterator& operator++() { m_coroutine.resume(); return *this; }
+		void operator++( int ) { ++*this; }
+		bool operator==( std::default_sentinel_t ) const { return !m_coroutine || m_coroutine.done(); }
+
+	private:
+
+		std::coroutine_handle< promise_type > m_coroutine;
+	};
+
+	Generator() = default;
+	explicit Generator( std::coroutine_handle< promise_type > coroutine ) : m_coroutine( coroutine ) {}
+	~Generator() { if( m_coroutine ) { m_coroutine.destroy(); } }
+
+	/// No copy operations
+	Generator( const Generator& other ) = delete;
+	Generator& operator=( const Generator& other ) = delete;
+
+	/// Move operations
+	Generator( Generator&& other ) noexcept : m_coroutine( std::exchange( other.m_coroutine, nullptr ) ) {}
+	Generator& operator=( Generator&& other ) noexcept
+	{
+		if( this != &other )
+		{
+			if( m_coroutine )
+			{
+				m_coroutine.destroy();
+			}
+			m_coroutine = std::exchange( other.m_coroutine, nullptr );
+		}
+		return *this;
+	}
+
+	Iterator begin()
+	{
+		if( m_coroutine && !m_coroutine.done() && m_coroutine.promise().current == nullptr )
+		{
+			m_coroutine.resume();
+		}
+		return Iterator( m_coroutine );
+	}
+	std::default_sentinel_t end() const { return std::default_sentinel; }
+
+private:
+
+	std::coroutine_handle< promise_type > m_coroutine;
+};
+
+/// Returns coroutine yielding bag's draws, refilled through batch GetNext(). The bag must outlive the generator.
+template< typename BagType >
+Generator< int > GenerateMarbles( BagType& bag )
+{
+	std::array< int, 64 > buffer;
+	while( true )
+	{
+		int numDrawn = bag.GetNext( buffer.data(), static_cast< int >( buffer.size() ) );
+		for( int i = 0; i < numDrawn; ++i )
+		{
+			co_yield buffer[ i ];
+		}
+		if( numDrawn < static_cast< int >( buffer.size() ) )
+		{
+			co_return;
+		}
+	}
+}
+
+#endif
+
+}
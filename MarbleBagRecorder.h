@@ -0,0 +1,434 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagRecorder.h
+* Compact recording of a bag's output and deterministic replay with random access.
+*
+* Encoding is a stream of LEB128 varints. A draw is ( zigzag( value - previousValue ) << 1 ), where
+* values are stored offset by one so an exhausted -1 draw is representable. A token of 1 marks the
+* end of a cycle (a Reset() of a bag with marbles removed, including auto-resets). Draws within 31
+* of the previous value take one byte. Every CheckpointInterval draws the recording keeps the byte offset and
+* decoder state, so DrawReplayer::Seek() decodes at most CheckpointInterval draws.
+*
+* Usage:
+*	DrawRecording recording( 100 );													// Recording of a 100 marble bag
+*	MarbleBag< 100, std::default_random_engine, RecordingMarbleBagObserver > bag;
+*	bag.GetObserver().SetRecording( &recording );									// Bag appends every draw and cycle end
+*	std::vector< std::uint8_t > bytes = recording.Serialize();						// Persist
+*	DrawReplayer replayer( recording );												// Replays with the bag interface
+*	int value = replayer.GetNext();													// Same value the bag returned
+*	replayer.Seek( 1000000 );														// Next GetNext() returns draw 1000000
+*
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace crux
+{
+/// Encoded draws of one bag plus a checkpoint index for random access.
+class DrawRecording
+{
+public:
+
+	/// Decoder state at a draw index that is a multiple of CheckpointInterval.
+	struct Checkpoint
+	{
+		std::uint64_t byteOffset;
+		std::uint64_t cycleIndex;
+		int previousValue;
+		int drawsInCycle;
+	};
+
+	static const int CheckpointInterval = 4096;
+
+	/// Constructor with the number of marbles of the recorded bag
+	explicit DrawRecording( int numMarbles = 0 );
+
+	/// Appends a GetNext() result, -1 included.
+	void AppendDraw( int value );
+
+	/// Appends end of cycle marker.
+	void AppendCycleEnd();
+
+	/// Removes all recorded draws.
+	void Clear();
+
+	int GetNumMarbles() const { return m_numMarbles; }
+	std::uint64_t GetNumDraws() const { return m_numDraws; }
+	const std::vector< std::uint8_t >& GetBytes() const { return m_bytes; }
+	const std::vector< Checkpoint >& GetCheckpoints() const { return m_checkpoints; }
+
+	/// Returns self-contained byte blob of the recording.
+	std::vector< std::uint8_t > Serialize() const;
+
+	/// Replaces contents from Serialize() output and rebuilds checkpoints. Returns false if data is malformed.
+	bool Deserialize( const std::uint8_t* data, std::size_t size );
+
+private:
+
+	void AppendVarint( std::uint64_t value );
+
+private:
+
+	std::vector< std::uint8_t > m_bytes;
+	std::vector< Checkpoint > m_checkpoints;
+	std::uint64_t m_numDraws = { 0 };
+	std::uint64_t m_cycleIndex = { 0 };
+	int m_numMarbles;
+	int m_previousValue = { 0 };
+	int m_drawsInCycle = { 0 };
+};
+
+/// Observer appending a bag's draws and cycle ends to a DrawRecording.
+class RecordingMarbleBagObserver
+{
+public:
+
+	void SetRecording( DrawRecording* recording ) { m_recording = recording; }
+
+	void OnGetNextBegin() {}
+	void OnDraw( int value, int /*probeLength*/, int /*remainingCount*/ ) { if( m_recording ) { m_recording->AppendDraw( value ); } }
+	void OnReset( int numRemoved, int /*remainingCount*/ ) { if( m_recording && numRemoved > 0 ) { m_recording->AppendCycleEnd(); } }
+	void OnResetEnd() {}
+	void OnAutoReset() {}
+	void OnExhausted() { if( m_recording ) { m_recording->AppendDraw( -1 ); } }
+	void OnRollBegin() {}
+	void OnRollEnd() {}
+
+private:
+
+	DrawRecording* m_recording = { nullptr };
+};
+
+/// Plays back a DrawRecording through the bag interface. The recording must outlive the replayer.
+class DrawReplayer
+{
+public:
+
+	/// Constructor, positioned at the first draw
+	explicit DrawReplayer( const DrawRecording& recording );
+
+	/// Returns next recorded value. Returns -1 past the end of the recording.
+	const int GetNext();
+
+	/// Returns if recorded draws remain.
+	bool HasNext() const;
+
+	/// Returns quantity of marble values that remained in the recorded bag at this point.
+	const int GetRemainingCount() const;
+
+	/// Returns if the recorded bag had marbles remaining at this point.
+	bool HasMarbles() const;
+
+	/// Positions replay so the next GetNext() returns draw drawIndex. Returns false if drawIndex is past the end.
+	bool Seek( std::uint64_t drawIndex );
+
+	/// Returns value of draw drawIndex without changing position. Returns -1 if past the end.
+	int GetAt( std::uint64_t drawIndex ) const;
+
+	/// Returns index of the draw the next GetNext() returns.
+	std::uint64_t GetDrawIndex() const { return m_drawIndex; }
+
+	/// Returns number of cycle ends passed so far.
+	std::uint64_t GetCycleIndex() const { return m_cycleIndex; }
+
+private:
+
+	bool ReadVarint( std::uint64_t& value );
+
+	void SkipCycleMarkers();
+
+private:
+
+	const DrawRecording& m_recording;
+	std::uint64_t m_byteOffset = { 0 };
+	std::uint64_t m_drawIndex = { 0 };
+	std::uint64_t m_cycleIndex = { 0 };
+	int m_previousValue = { 0 };
+	int m_drawsInCycle = { 0 };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// DrawRecording
+//
+
+inline DrawRecording::DrawRecording( int numMarbles )
+	: m_numMarbles( numMarbles )
+{}
+
+inline void DrawRecording::AppendVarint( std::uint64_t value )
+{
+	while( value >= 0x80 )
+	{
+		m_bytes.push_back( static_cast< std::uint8_t >( value | 0x80 ) );
+		value >>= 7;
+	}
+	m_bytes.push_back( static_cast< std::uint8_t >( value ) );
+}
+
+inline void DrawRecording::AppendDraw( int value )
+{
+	if( m_numDraws % CheckpointInterval == 0 )
+	{
+		m_checkpoints.push_back( Checkpoint{ m_bytes.size(), m_cycleIndex, m_previousValue, m_drawsInCycle } );
+	}
+	std::int64_t delta = static_cast< std::int64_t >( value + 1 ) - m_previousValue;
+	std::uint64_t zigzag = ( static_cast< std::uint64_t >( delta ) << 1 ) ^ static_cast< std::uint64_t >( delta >> 63 );
+	AppendVarint( zigzag << 1 );
+	m_previousValue = value + 1;
+	++m_numDraws;
+	if( value >= 0 )
+	{
+		++m_drawsInCycle;
+	}
+}
+
+inline void DrawRecording::AppendCycleEnd()
+{
+	AppendVarint( 1 );
+	++m_cycleIndex;
+	m_drawsInCycle = 0;
+}
+
+inline void DrawRecording::Clear()
+{
+	m_bytes.clear();
+	m_checkpoints.clear();
+	m_numDraws = 0;
+	m_cycleIndex = 0;
+	m_previousValue = 0;
+	m_drawsInCycle = 0;
+}
+
+inline std::vector< std::uint8_t > DrawRecording::Serialize() const
+{
+	// Header: "MBR1", numMarbles, numDraws, byte count, all little-endian
+	std::vector< std::uint8_t > blob;
+	blob.reserve( 24 + m_bytes.size() );
+	const char magic[ 4 ] = { 'M', 'B', 'R', '1' };
+	blob.insert( blob.end(), magic, magic + 4 );
+	std::uint64_t fields[] = { static_cast< std::uint32_t >( m_numMarbles ), m_numDraws, m_bytes.size() };
+	for( int f = 0; f < 3; ++f )
+	{
+		int numBytes = f == 0 ? 4 : 8;
+		for( int b = 0; b < numBytes; ++b )
+		{
+			blob.push_back( static_cast< std::uint8_t >( fields[ f ] >> ( 8 * b ) ) );
+		}
+	}
+	blob.insert( blob.end(), m_bytes.begin(), m_bytes.end() );
+	return blob;
+}
+
+inline bool DrawRecording::Deserialize( const std::uint8_t* data, std::size_t size )
+{
+	const std::size_t headerSize = 24;
+	if( size < headerSize || std::memcmp( data, "MBR1", 4 ) != 0 )
+	{
+		return false;
+	}
+	std::uint64_t fields[ 3 ] = {};
+	std::size_t offset = 4;
+	for( int f = 0; f < 3; ++f )
+	{
+		int numBytes = f == 0 ? 4 : 8;
+		for( int b = 0; b < numBytes; ++b )
+		{
+			fields[ f ] |= static_cast< std::uint64_t >( data[ offset++ ] ) << ( 8 * b );
+		}
+	}
+	if( fields[ 2 ] != size - headerSize )
+	{
+		return false;
+	}
+
+	// Re-encode through the append path to rebuild checkpoints and validate the stream.
+	DrawRecording rebuilt( static_cast< int >( fields[ 0 ] ) );
+	rebuilt.m_bytes.reserve( static_cast< std::size_t >( fields[ 2 ] ) );
+	int previousValue = 0;
+	for( std::size_t position = headerSize; position < size; )
+	{
+		std::uint64_t token = 0;
+		int shift = 0;
+		bool bComplete = false;
+		while( position < size && shift < 64 )
+		{
+			std::uint8_t byte = data[ position++ ];
+			token |= static_cast< std::uint64_t >( byte & 0x7f ) << shift;
+			shift += 7;
+			if( ( byte & 0x80 ) == 0 )
+			{
+				bComplete = true;
+				break;
+			}
+		}
+		if( !bComplete )
+		{
+			return false;
+		}
+		if( token & 1 )
+		{
+			rebuilt.AppendCycleEnd();
+			continue;
+		}
+		std::uint64_t zigzag = token >> 1;
+		std::int64_t delta = static_cast< std::int64_t >( zigzag >> 1 ) ^ -static_cast< std::int64_t >( zigzag & 1 );
+		previousValue = static_cast< int >( previousValue + delta );
+		rebuilt.AppendDraw( previousValue - 1 );
+	}
+	if( rebuilt.m_numDraws != fields[ 1 ] )
+	{
+		return false;
+	}
+	*this = std::move( rebuilt );
+	return true;
+}
+
+//
+// DrawReplayer
+//
+
+inline DrawReplayer::DrawReplayer( const DrawRecording& recording )
+	: m_recording( recording )
+{}
+
+inline bool DrawReplayer::ReadVarint( std::uint64_t& value )
+{
+	const std::vector< std::uint8_t >& bytes = m_recording.GetBytes();
+	value = 0;
+	for( int shift = 0; m_byteOffset < bytes.size() && shift < 64; shift += 7 )
+	{
+		std::uint8_t byte = bytes[ static_cast< std::size_t >( m_byteOffset++ ) ];
+		value |= static_cast< std::uint64_t >( byte & 0x7f ) << shift;
+		if( ( byte & 0x80 ) == 0 )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void DrawReplayer::SkipCycleMarkers()
+{
+	const std::vector< std::uint8_t >& bytes = m_recording.GetBytes();
+	while( m_byteOffset < bytes.size() && bytes[ static_cast< std::size_t >( m_byteOffset ) ] == 1 )
+	{
+		++m_byteOffset;
+		++m_cycleIndex;
+		m_drawsInCycle = 0;
+	}
+}
+
+inline const int DrawReplayer::GetNext()
+{
+	SkipCycleMarkers();
+	std::uint64_t token;
+	if( !HasNext() || !ReadVarint( token ) )
+	{
+		return -1;
+	}
+	std::uint64_t zigzag = token >> 1;
+	std::int64_t delta = static_cast< std::int64_t >( zigzag >> 1 ) ^ -static_cast< std::int64_t >( zigzag & 1 );
+	m_previousValue = static_cast< int >( m_previousValue + delta );
+	++m_drawIndex;
+	int value = m_previousValue - 1;
+	if( value >= 0 )
+	{
+		++m_drawsInCycle;
+	}
+	return value;
+}
+
+inline bool DrawReplayer::HasNext() const
+{
+	return m_drawIndex < m_recording.GetNumDraws();
+}
+
+inline const int DrawReplayer::GetRemainingCount() const
+{
+	return m_recording.GetNumMarbles() - m_drawsInCycle;
+}
+
+inline bool DrawReplayer::HasMarbles() const
+{
+	return GetRemainingCount() > 0;
+}
+
+inline bool DrawReplayer::Seek( std::uint64_t drawIndex )
+{
+	if( drawIndex > m_recording.GetNumDraws() )
+	{
+		return false;
+	}
+	const std::vector< DrawRecording::Checkpoint >& checkpoints = m_recording.GetCheckpoints();
+	std::uint64_t checkpointIndex = drawIndex / DrawRecording::CheckpointInterval;
+	if( !checkpoints.empty() && checkpointIndex >= checkpoints.size() )
+	{
+		checkpointIndex = checkpoints.size() - 1;
+	}
+	std::uint64_t checkpointDraw = checkpoints.empty() ? 0 : checkpointIndex * DrawRecording::CheckpointInterval;
+	if( m_drawIndex > drawIndex || m_drawIndex < checkpointDraw )
+	{
+		if( checkpoints.empty() )
+		{
+			m_byteOffset = 0;
+			m_cycleIndex = 0;
+			m_previousValue = 0;
+			m_drawsInCycle = 0;
+		}
+		else
+		{
+			const DrawRecording::Checkpoint& checkpoint = checkpoints[ static_cast< std::size_t >( checkpointIndex ) ];
+			m_byteOffset = checkpoint.byteOffset;
+			m_cycleIndex = checkpoint.cycleIndex;
+			m_previousValue = checkpoint.previousValue;
+			m_drawsInCycle = checkpoint.drawsInCycle;
+		}
+		m_drawIndex = checkpointDraw;
+	}
+	while( m_drawIndex < drawIndex )
+	{
+		GetNext();
+	}
+	return true;
+}
+
+inline int DrawReplayer::GetAt( std::uint64_t drawIndex ) const
+{
+	if( drawIndex >= m_recording.GetNumDraws() )
+	{
+		return -1;
+	}
+	DrawReplayer cursor( m_recording );
+	cursor.Seek( drawIndex );
+	return cursor.GetNext();
+}
+
+}
@@ -0,0 +1,199 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* PeekableMarbleBag.h
+* Lookahead over any bag with a batch GetNext(): Peek( i ) shows the value GetNext() will return i draws from now.
+* Upcoming draws wait in a fixed ring buffer of RingSize values. Whenever a peek or draw needs more than
+* is buffered, every free slot is filled with at most two batch GetNext() calls on the wrapped bag, so draws
+* continue across auto-resets exactly as the bag produces them. GetNext() is then a pop from the ring.
+* Buffered values were already drawn from the wrapped bag: after resetting or reseeding it through GetBag(),
+* call ClearLookahead() if the queued values should be dropped.
+*
+* Usage:
+*	PeekableMarbleBag< MarbleBag< 7 >, 5 > pieces( MarbleBag< 7 >{} );					// Next 5 pieces visible
+*	int upcoming = pieces.Peek( 2 );													// Value returned by the third GetNext() from now
+*	int piece = pieces.GetNext();														// Pops the front of the lookahead
+*
+*/
+
+#pragma once
+
+#include <array>
+#include <utility>
+
+namespace crux
+{
+/// Bag wrapper exposing the next LookaheadSize values before they are drawn.
+template< typename BagType, int LookaheadSize, int RingSize = 64 >
+class PeekableMarbleBag
+{
+	static_assert( LookaheadSize > 0 && LookaheadSize <= RingSize, "Lookahead must fit the ring" );
+	static_assert( ( RingSize & ( RingSize - 1 ) ) == 0, "RingSize must be a power of two" );
+
+public:
+
+	/// Constructor taking ownership of bag
+	explicit PeekableMarbleBag( BagType&& bag );
+
+	/// Destructor
+	~PeekableMarbleBag() = default;
+
+	/// No copy operations
+	PeekableMarbleBag( const PeekableMarbleBag< BagType, LookaheadSize, RingSize >& other ) = delete;
+	PeekableMarbleBag& operator=( const PeekableMarbleBag< BagType, LookaheadSize, RingSize >& other ) = delete;
+
+	/// Move operations
+	PeekableMarbleBag( PeekableMarbleBag< BagType, LookaheadSize, RingSize >&& other ) = default;
+	PeekableMarbleBag& operator=( PeekableMarbleBag< BagType, LookaheadSize, RingSize >&& other ) = default;
+
+	/// Returns value GetNext() will return after index more draws, index below LookaheadSize. Returns -1 if the bag runs out first.
+	int Peek( int index );
+
+	/// Returns next marble value. Returns -1 if no marbles remain.
+	int GetNext();
+
+	/// Writes up to count next marble values. Returns number written, less than count only if marbles ran out without bAutoReset.
+	int GetNext( int* outValues, int count );
+
+	/// Returns quantity of values drawn from the bag and not yet returned.
+	int GetNumBuffered() const;
+
+	/// Drops buffered values, the next peek or draw refills from the bag.
+	void ClearLookahead();
+
+	/// Returns wrapped bag.
+	BagType& GetBag();
+	const BagType& GetBag() const;
+
+private:
+
+	bool Fill( int numNeeded );
+
+private:
+
+	BagType m_bag;
+	std::array< int, RingSize > m_ring = {};
+	int m_head = { 0 };
+	int m_numBuffered = { 0 };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< typename BagType, int LookaheadSize, int RingSize >
+BagType& PeekableMarbleBag< BagType, LookaheadSize, RingSize >::GetBag()
+{
+	return m_bag;
+}
+
+template< typename BagType, int LookaheadSize, int RingSize >
+const BagType& PeekableMarbleBag< BagType, LookaheadSize, RingSize >::GetBag() const
+{
+	return m_bag;
+}
+
+template< typename BagType, int LookaheadSize, int RingSize >
+void PeekableMarbleBag< BagType, LookaheadSize, RingSize >::ClearLookahead()
+{
+	m_head = 0;
+	m_numBuffered = 0;
+}
+
+template< typename BagType, int LookaheadSize, int RingSize >
+int PeekableMarbleBag< BagType, LookaheadSize, RingSize >::GetNumBuffered() const
+{
+	return m_numBuffered;
+}
+
+template< typename BagType, int LookaheadSize, int RingSize >
+int PeekableMarbleBag< BagType, LookaheadSize, RingSize >::Peek( int index )
+{
+	if( !Fill( index + 1 ) )
+	{
+		return -1;
+	}
+	return m_ring[ ( m_head + index ) & ( RingSize - 1 ) ];
+}
+
+template< typename BagType, int LookaheadSize, int RingSize >
+int PeekableMarbleBag< BagType, LookaheadSize, RingSize >::GetNext()
+{
+	if( !Fill( 1 ) )
+	{
+		return -1;
+	}
+	int value = m_ring[ m_head ];
+	m_head = ( m_head + 1 ) & ( RingSize - 1 );
+	--m_numBuffered;
+	return value;
+}
+
+template< typename BagType, int LookaheadSize, int RingSize >
+int PeekableMarbleBag< BagType, LookaheadSize, RingSize >::GetNext( int* outValues, int count )
+{
+	// Buffered values first, then straight from the bag; the ring refills on the next peek or draw.
+	int numFromRing = count < m_numBuffered ? count : m_numBuffered;
+	for( int i = 0; i < numFromRing; ++i )
+	{
+		outValues[ i ] = m_ring[ ( m_head + i ) & ( RingSize - 1 ) ];
+	}
+	m_head = ( m_head + numFromRing ) & ( RingSize - 1 );
+	m_numBuffered -= numFromRing;
+	return numFromRing + m_bag.GetNext( outValues + numFromRing, count - numFromRing );
+}
+
+template< typename BagType, int LookaheadSize, int RingSize >
+PeekableMarbleBag< BagType, LookaheadSize, RingSize >::PeekableMarbleBag( BagType&& bag )
+	: m_bag( std::forward< BagType >( bag ) )
+{}
+
+//
+// Private
+//
+
+template< typename BagType, int LookaheadSize, int RingSize >
+bool PeekableMarbleBag< BagType, LookaheadSize, RingSize >::Fill( int numNeeded )
+{
+	if( m_numBuffered >= numNeeded )
+	{
+		return true;
+	}
+	// Free slots are at most two contiguous runs: from the tail to the end of the array, then from its start up to the head.
+	while( m_numBuffered < RingSize )
+	{
+		int tail = ( m_head + m_numBuffered ) & ( RingSize - 1 );
+		int runLength = tail >= m_head ? RingSize - tail : m_head - tail;
+		int numDrawn = m_bag.GetNext( m_ring.data() + tail, runLength );
+		m_numBuffered += numDrawn;
+		if( numDrawn < runLength )
+		{
+			break;
+		}
+	}
+	return m_numBuffered >= numNeeded;
+}
+
+}
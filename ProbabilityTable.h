@@ -0,0 +1,228 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* ProbabilityTable.h
+* Compiles floating point drop rates into whole marble counts.
+* CompileProbabilityTable() tries cycle lengths 1, 2, 3, ... and apportions each one with the
+* largest remainder method: every category gets the floor of its quota, then the leftover marbles
+* go to the largest fractional remainders, ties to the lower index. The first cycle length whose
+* worst | count / numMarbles - rate | is within tolerance is returned. Rates are normalized by their sum.
+* Rates must be finite and non-negative with a positive sum: the vector overload returns an invalid table
+* otherwise, and the constexpr overload fails to compile when evaluated at compile time.
+* The fixed size overload is constexpr, so static tables size a MarbleBag at compile time; the vector
+* overload is for tables loaded from data. Counts feed a WeightedMarbleBag, or index ranges of a MarbleBag via GetCategory().
+* Compile time evaluation is bounded by the compiler's constexpr step limit, keep tolerances for static tables moderate.
+*
+* Usage:
+*	constexpr double rates[] = { 0.0035, 0.125, 0.8715 };
+*	constexpr auto table = CompileProbabilityTable( rates, 0.0005 );			// Smallest cycle within 0.05% per category
+*	static_assert( table.IsValid(), "No cycle length meets tolerance" );
+*	MarbleBag< table.numMarbles > bag;											// Bag sized by the table
+*	int category = table.GetCategory( bag.GetNext() );							// Category owning the drawn value
+*	DynamicProbabilityTable loaded = CompileProbabilityTable( rateVector, 0.0001 );	// Load time table
+*
+*/
+
+#pragma once
+
+#include <limits>
+#include <vector>
+
+namespace crux
+{
+/// Default upper bound on cycle length searched by CompileProbabilityTable().
+const int DefaultMaxTableMarbles = 1 << 20;
+
+namespace detail
+{
+/// Returns if every rate is finite and non-negative and their sum is positive and finite.
+constexpr bool AreRatesValid( const double* rates, int numCategories )
+{
+	double rateSum = 0.0;
+	for( int i = 0; i < numCategories; ++i )
+	{
+		// Also false for NaN.
+		if( !( rates[ i ] >= 0.0 && rates[ i ] <= std::numeric_limits< double >::max() ) )
+		{
+			return false;
+		}
+		rateSum += rates[ i ];
+	}
+	return rateSum > 0.0 && rateSum <= std::numeric_limits< double >::max();
+}
+
+/// Returns an invalid table. Not constexpr, so constant evaluation reaching it fails to compile.
+template< typename TableType >
+inline TableType RejectInvalidRates()
+{
+	return TableType{};
+}
+
+/// Apportions numMarbles over rates by largest remainder into outCounts. Returns worst absolute rate error.
+constexpr double ApportionCounts( const double* rates, int numCategories, int numMarbles, int* outCounts )
+{
+	double rateSum = 0.0;
+	for( int i = 0; i < numCategories; ++i )
+	{
+		rateSum += rates[ i ];
+	}
+	int numAssigned = 0;
+	for( int i = 0; i < numCategories; ++i )
+	{
+		outCounts[ i ] = static_cast< int >( rates[ i ] / rateSum * numMarbles );
+		numAssigned += outCounts[ i ];
+	}
+	// Each leftover marble goes to the largest remainder. A category that already received one has a
+	// negative remainder, so it is never picked twice. Rounding can overshoot, which takes back from the smallest.
+	for( ; numAssigned < numMarbles; ++numAssigned )
+	{
+		int bestIdx = 0;
+		for( int i = 1; i < numCategories; ++i )
+		{
+			if( rates[ i ] / rateSum * numMarbles - outCounts[ i ] > rates[ bestIdx ] / rateSum * numMarbles - outCounts[ bestIdx ] )
+			{
+				bestIdx = i;
+			}
+		}
+		++outCounts[ bestIdx ];
+	}
+	for( ; numAssigned > numMarbles; --numAssigned )
+	{
+		int worstIdx = -1;
+		for( int i = 0; i < numCategories; ++i )
+		{
+			if( outCounts[ i ] > 0 && ( worstIdx < 0 || rates[ i ] / rateSum * numMarbles - outCounts[ i ] < rates[ worstIdx ] / rateSum * numMarbles - outCounts[ worstIdx ] ) )
+			{
+				worstIdx = i;
+			}
+		}
+		--outCounts[ worstIdx ];
+	}
+	double maxError = 0.0;
+	for( int i = 0; i < numCategories; ++i )
+	{
+		double error = static_cast< double >( outCounts[ i ] ) / numMarbles - rates[ i ] / rateSum;
+		maxError = error < 0.0 ? ( -error > maxError ? -error : maxError ) : ( error > maxError ? error : maxError );
+	}
+	return maxError;
+}
+
+/// Returns category whose index range [ first, first + count ) holds value, or -1.
+constexpr int FindCategory( const int* counts, int numCategories, int value )
+{
+	for( int i = 0; i < numCategories; ++i )
+	{
+		if( value < counts[ i ] )
+		{
+			return i;
+		}
+		value -= counts[ i ];
+	}
+	return -1;
+}
+}
+
+/// Marble counts per category, usable in constant expressions.
+template< int NumCategories >
+struct ProbabilityTable
+{
+	/// Cycle length, 0 if no length up to the search limit met the tolerance
+	int numMarbles = { 0 };
+
+	/// Marbles per category, category i owns values [ sum of counts before i, + counts[ i ] )
+	int counts[ NumCategories ] = {};
+
+	/// Worst absolute difference between count / numMarbles and the requested rate
+	double maxError = { 0.0 };
+
+	constexpr bool IsValid() const { return numMarbles > 0; }
+	constexpr int GetNumCategories() const { return NumCategories; }
+	constexpr const int* GetCounts() const { return counts; }
+
+	/// Returns category owning marble value, or -1 if value is out of range.
+	constexpr int GetCategory( int value ) const { return detail::FindCategory( counts, NumCategories, value ); }
+};
+
+/// Marble counts per category for tables built at load time.
+struct DynamicProbabilityTable
+{
+	/// Cycle length, 0 if no length up to the search limit met the tolerance
+	int numMarbles = { 0 };
+
+	/// Marbles per category, category i owns values [ sum of counts before i, + counts[ i ] )
+	std::vector< int > counts;
+
+	/// Worst absolute difference between count / numMarbles and the requested rate
+	double maxError = { 0.0 };
+
+	bool IsValid() const { return numMarbles > 0; }
+	int GetNumCategories() const { return static_cast< int >( counts.size() ); }
+	const int* GetCounts() const { return counts.data(); }
+
+	/// Returns category owning marble value, or -1 if value is out of range.
+	int GetCategory( int value ) const { return detail::FindCategory( counts.data(), GetNumCategories(), value ); }
+};
+
+/// Returns table with the smallest cycle length whose per-category rate error is within tolerance. Rates must be finite and
+/// non-negative with a positive sum; invalid rates do not compile in a constant expression and give an invalid table at run time.
+template< int NumCategories >
+constexpr ProbabilityTable< NumCategories > CompileProbabilityTable( const double ( &rates )[ NumCategories ], double tolerance, int maxMarbles = DefaultMaxTableMarbles )
+{
+	if( !detail::AreRatesValid( rates, NumCategories ) )
+	{
+		return detail::RejectInvalidRates< ProbabilityTable< NumCategories > >();
+	}
+	ProbabilityTable< NumCategories > table;
+	for( int numMarbles = 1; numMarbles <= maxMarbles; ++numMarbles )
+	{
+		table.maxError = detail::ApportionCounts( rates, NumCategories, numMarbles, table.counts );
+		if( table.maxError <= tolerance )
+		{
+			table.numMarbles = numMarbles;
+			return table;
+		}
+	}
+	return ProbabilityTable< NumCategories >{};
+}
+
+/// Returns table with the smallest cycle length whose per-category rate error is within tolerance. Returns an invalid table
+/// if any rate is negative or not finite, or their sum is not positive.
+inline DynamicProbabilityTable CompileProbabilityTable( const std::vector< double >& rates, double tolerance, int maxMarbles = DefaultMaxTableMarbles )
+{
+	DynamicProbabilityTable table;
+	if( !detail::AreRatesValid( rates.data(), static_cast< int >( rates.size() ) ) )
+	{
+		return table;
+	}
+	table.counts.resize( rates.size() );
+	for( int numMarbles = 1; numMarbles <= maxMarbles; ++numMarbles )
+	{
+		table.maxError = detail::ApportionCounts( rates.data(), table.GetNumCategories(), numMarbles, table.counts.data() );
+		if( table.maxError <= tolerance )
+		{
+			table.numMarbles = numMarbles;
+			return table;
+		}
+	}
+	return DynamicProbabilityTable{};
+}
+
+}
@@ -0,0 +1,475 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* TieredMarbleBag.h
+* Two level bag of bags for tiered loot: a tier bag picks the rarity, then that tier's item bag picks the item.
+* The tier bag holds tierCounts[ t ] marbles for tier t, the item bag of tier t holds itemCounts[ t ] marbles.
+* All state lives in one word array: a three word record per tier (tier marbles and remaining, item
+* count and removed, first bitmap word) followed by every tier's item bitmap, so a draw touches one
+* contiguous allocation and Serialize() writes it as is. Item selection uses the word-level helpers of MarbleBagBits.h.
+* Reset policy is chosen per level: WhenEmpty refills a bag once it runs out, WithParent also refills every
+* item bag whenever the tier bag refills, Never leaves an empty bag empty. On the tier level WithParent acts as WhenEmpty.
+* Negative counts, or counts whose total exceeds INT_MAX, are rejected: the bag is then constructed without tiers.
+* Move constructor and move assignment only, no copy.
+*
+* Usage:
+*	const int tierCounts[] = { 80, 17, 3 };											// Common, rare, legendary marbles in the tier bag
+*	const int itemCounts[] = { 40, 12, 5 };											// Items per tier
+*	TieredMarbleBag<> bag( tierCounts, itemCounts, 3 );								// Chrono-based seed
+*	bag.itemResetPolicy = TierResetPolicy::WithParent;								// Item bags refill with each tier cycle
+*	TieredDraw drop = bag.GetNext();												// drop.tier, drop.item
+*	std::vector< std::uint8_t > blob = bag.Serialize();							// Whole tree in one blob
+*
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "MarbleBagBits.h"
+
+namespace crux
+{
+/// When a level of a TieredMarbleBag refills.
+enum class TierResetPolicy : std::uint8_t
+{
+	WhenEmpty,
+	WithParent,
+	Never
+};
+
+/// Result of a TieredMarbleBag draw. tier is -1 if the tier bag is empty, item is -1 if the tier's item bag is empty.
+struct TieredDraw
+{
+	int tier;
+	int item;
+};
+
+/// Utility for dependent probability of a tier followed by an item within the tier.
+template< typename RandomEngineType = std::default_random_engine >
+class TieredMarbleBag
+{
+public:
+
+	/// Constructor with chrono-based seed
+	TieredMarbleBag( const int* tierCounts, const int* itemCounts, int numTiers );
+
+	/// Constructor with move of random engine type
+	TieredMarbleBag( const int* tierCounts, const int* itemCounts, int numTiers, RandomEngineType&& randomEngine );
+
+	/// Destructor
+	~TieredMarbleBag() = default;
+
+	/// No copy operations
+	TieredMarbleBag( const TieredMarbleBag< RandomEngineType >& other ) = delete;
+	TieredMarbleBag& operator=( const TieredMarbleBag< RandomEngineType >& other ) = delete;
+
+	/// Move operations
+	TieredMarbleBag( TieredMarbleBag< RandomEngineType >&& other ) = default;
+	TieredMarbleBag& operator=( TieredMarbleBag< RandomEngineType >&& other ) = default;
+
+	/// Returns next tier and item within it.
+	TieredDraw GetNext();
+
+	/// Returns quantity of tier marbles that still exist.
+	const int GetRemainingCount() const;
+
+	/// Returns quantity of items of a tier that still exist.
+	const int GetRemainingItemCount( int tier ) const;
+
+	/// Returns quantity of tiers.
+	const int GetNumTiers() const;
+
+	/// Returns if any tier marbles remain.
+	bool HasMarbles() const;
+
+	/// Returns all tier and item marbles to their bags.
+	void Reset();
+
+	/// Explicitly set random engine.
+	void SetRandomEngine( RandomEngineType&& randomEngine );
+
+	/// Returns little-endian blob of policies and the word array. The random engine is not included.
+	std::vector< std::uint8_t > Serialize() const;
+
+	/// Replaces state from Serialize() output. Returns false if data is malformed.
+	bool Deserialize( const std::uint8_t* data, std::size_t size );
+
+private:
+
+	/// 32-bit halves of a tier record, two per word
+	enum TierField
+	{
+		TierMarbles,
+		TierRemaining,
+		ItemCount,
+		ItemsRemoved,
+		FirstItemWord,
+		TierRecordFields = 6
+	};
+
+	static const int TierRecordWords = TierRecordFields / 2;
+
+	std::uint32_t GetTierField( int tier, TierField field ) const;
+
+	void SetTierField( int tier, TierField field, std::uint32_t value );
+
+	void ResetTiers();
+
+	void ResetItems( int tier );
+
+	int DrawItem( int tier );
+
+	bool IsConsistent() const;
+
+	static bool AreCountsValid( const int* tierCounts, const int* itemCounts, int numTiers );
+
+private:
+
+	RandomEngineType m_randomEngine;
+	std::vector< std::uint64_t > m_nodes;
+	int m_numTiers = { 0 };
+	int m_numTierMarbles = { 0 };
+	int m_numTierRemaining = { 0 };
+
+public:
+
+	/// Refill policy of the tier bag
+	TierResetPolicy tierResetPolicy = { TierResetPolicy::WhenEmpty };
+
+	/// Refill policy of every item bag
+	TierResetPolicy itemResetPolicy = { TierResetPolicy::WhenEmpty };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< typename RandomEngineType >
+void TieredMarbleBag< RandomEngineType >::SetRandomEngine( RandomEngineType&& randomEngine )
+{
+	m_randomEngine = std::forward< RandomEngineType >( randomEngine );
+}
+
+template< typename RandomEngineType >
+void TieredMarbleBag< RandomEngineType >::Reset()
+{
+	ResetTiers();
+	for( int tier = 0; tier < m_numTiers; ++tier )
+	{
+		ResetItems( tier );
+	}
+}
+
+template< typename RandomEngineType >
+bool TieredMarbleBag< RandomEngineType >::HasMarbles() const
+{
+	return m_numTierRemaining > 0;
+}
+
+template< typename RandomEngineType >
+const int TieredMarbleBag< RandomEngineType >::GetNumTiers() const
+{
+	return m_numTiers;
+}
+
+template< typename RandomEngineType >
+const int TieredMarbleBag< RandomEngineType >::GetRemainingItemCount( int tier ) const
+{
+	return static_cast< int >( GetTierField( tier, ItemCount ) - GetTierField( tier, ItemsRemoved ) );
+}
+
+template< typename RandomEngineType >
+const int TieredMarbleBag< RandomEngineType >::GetRemainingCount() const
+{
+	return m_numTierRemaining;
+}
+
+template< typename RandomEngineType >
+TieredDraw TieredMarbleBag< RandomEngineType >::GetNext()
+{
+	if( !HasMarbles() )
+	{
+		if( tierResetPolicy == TierResetPolicy::Never || m_numTierMarbles == 0 )
+		{
+			return TieredDraw{ -1, -1 };
+		}
+		ResetTiers();
+		if( itemResetPolicy == TierResetPolicy::WithParent )
+		{
+			for( int tier = 0; tier < m_numTiers; ++tier )
+			{
+				ResetItems( tier );
+			}
+		}
+	}
+	std::uniform_int_distribution< int > distribution( 0, m_numTierRemaining - 1 );
+	int roll = distribution( m_randomEngine );
+	int tier = 0;
+	while( roll >= static_cast< int >( GetTierField( tier, TierRemaining ) ) )
+	{
+		roll -= static_cast< int >( GetTierField( tier, TierRemaining ) );
+		++tier;
+	}
+	SetTierField( tier, TierRemaining, GetTierField( tier, TierRemaining ) - 1 );
+	--m_numTierRemaining;
+	return TieredDraw{ tier, DrawItem( tier ) };
+}
+
+template< typename RandomEngineType >
+std::vector< std::uint8_t > TieredMarbleBag< RandomEngineType >::Serialize() const
+{
+	// Header: "MBT1", numTiers, tier policy, item policy, two reserved bytes, word count, then words, all little-endian
+	std::vector< std::uint8_t > blob;
+	blob.reserve( 20 + m_nodes.size() * 8 );
+	const char magic[ 4 ] = { 'M', 'B', 'T', '1' };
+	blob.insert( blob.end(), magic, magic + 4 );
+	for( int b = 0; b < 4; ++b )
+	{
+		blob.push_back( static_cast< std::uint8_t >( static_cast< std::uint32_t >( m_numTiers ) >> ( 8 * b ) ) );
+	}
+	blob.push_back( static_cast< std::uint8_t >( tierResetPolicy ) );
+	blob.push_back( static_cast< std::uint8_t >( itemResetPolicy ) );
+	blob.push_back( 0 );
+	blob.push_back( 0 );
+	for( int b = 0; b < 8; ++b )
+	{
+		blob.push_back( static_cast< std::uint8_t >( static_cast< std::uint64_t >( m_nodes.size() ) >> ( 8 * b ) ) );
+	}
+	for( std::uint64_t word : m_nodes )
+	{
+		for( int b = 0; b < 8; ++b )
+		{
+			blob.push_back( static_cast< std::uint8_t >( word >> ( 8 * b ) ) );
+		}
+	}
+	return blob;
+}
+
+template< typename RandomEngineType >
+bool TieredMarbleBag< RandomEngineType >::Deserialize( const std::uint8_t* data, std::size_t size )
+{
+	const std::size_t headerSize = 20;
+	if( size < headerSize || std::memcmp( data, "MBT1", 4 ) != 0 || data[ 8 ] > 2 || data[ 9 ] > 2 )
+	{
+		return false;
+	}
+	std::uint32_t numTiers = 0;
+	std::uint64_t numWords = 0;
+	for( int b = 0; b < 4; ++b )
+	{
+		numTiers |= static_cast< std::uint32_t >( data[ 4 + b ] ) << ( 8 * b );
+	}
+	for( int b = 0; b < 8; ++b )
+	{
+		numWords |= static_cast< std::uint64_t >( data[ 12 + b ] ) << ( 8 * b );
+	}
+	if( numWords > ( size - headerSize ) / 8 || numWords * 8 != size - headerSize || numTiers > numWords / TierRecordWords )
+	{
+		return false;
+	}
+
+	std::vector< std::uint64_t > nodes( static_cast< std::size_t >( numWords ), 0 );
+	for( std::size_t i = 0; i < nodes.size(); ++i )
+	{
+		for( int b = 0; b < 8; ++b )
+		{
+			nodes[ i ] |= static_cast< std::uint64_t >( data[ headerSize + i * 8 + b ] ) << ( 8 * b );
+		}
+	}
+	std::vector< std::uint64_t > previousNodes = std::move( m_nodes );
+	int previousNumTiers = m_numTiers;
+	m_nodes = std::move( nodes );
+	m_numTiers = static_cast< int >( numTiers );
+	if( !IsConsistent() )
+	{
+		m_nodes = std::move( previousNodes );
+		m_numTiers = previousNumTiers;
+		return false;
+	}
+	m_numTierMarbles = 0;
+	m_numTierRemaining = 0;
+	for( int tier = 0; tier < m_numTiers; ++tier )
+	{
+		m_numTierMarbles += static_cast< int >( GetTierField( tier, TierMarbles ) );
+		m_numTierRemaining += static_cast< int >( GetTierField( tier, TierRemaining ) );
+	}
+	tierResetPolicy = static_cast< TierResetPolicy >( data[ 8 ] );
+	itemResetPolicy = static_cast< TierResetPolicy >( data[ 9 ] );
+	return true;
+}
+
+template< typename RandomEngineType >
+TieredMarbleBag< RandomEngineType >::TieredMarbleBag( const int* tierCounts, const int* itemCounts, int numTiers, RandomEngineType&& randomEngine )
+	: m_randomEngine( std::forward< RandomEngineType >( randomEngine ) )
+	, m_numTiers( AreCountsValid( tierCounts, itemCounts, numTiers ) ? numTiers : 0 )
+{
+	int numWords = m_numTiers * TierRecordWords;
+	m_nodes.resize( numWords, 0 );
+	for( int tier = 0; tier < m_numTiers; ++tier )
+	{
+		SetTierField( tier, TierMarbles, static_cast< std::uint32_t >( tierCounts[ tier ] ) );
+		SetTierField( tier, ItemCount, static_cast< std::uint32_t >( itemCounts[ tier ] ) );
+		SetTierField( tier, FirstItemWord, static_cast< std::uint32_t >( numWords ) );
+		numWords += detail::GetNumWords( itemCounts[ tier ] );
+		m_numTierMarbles += tierCounts[ tier ];
+	}
+	m_nodes.resize( numWords, 0 );
+	Reset();
+}
+
+template< typename RandomEngineType >
+TieredMarbleBag< RandomEngineType >::TieredMarbleBag( const int* tierCounts, const int* itemCounts, int numTiers )
+	: TieredMarbleBag( tierCounts, itemCounts, numTiers, std::move( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
+{}
+
+//
+// Private
+//
+
+template< typename RandomEngineType >
+std::uint32_t TieredMarbleBag< RandomEngineType >::GetTierField( int tier, TierField field ) const
+{
+	return static_cast< std::uint32_t >( m_nodes[ tier * TierRecordWords + field / 2 ] >> ( 32 * ( field % 2 ) ) );
+}
+
+template< typename RandomEngineType >
+void TieredMarbleBag< RandomEngineType >::SetTierField( int tier, TierField field, std::uint32_t value )
+{
+	std::uint64_t& word = m_nodes[ tier * TierRecordWords + field / 2 ];
+	int shift = 32 * ( field % 2 );
+	word = ( word & ~( std::uint64_t( 0xffffffff ) << shift ) ) | ( static_cast< std::uint64_t >( value ) << shift );
+}
+
+template< typename RandomEngineType >
+void TieredMarbleBag< RandomEngineType >::ResetTiers()
+{
+	for( int tier = 0; tier < m_numTiers; ++tier )
+	{
+		SetTierField( tier, TierRemaining, GetTierField( tier, TierMarbles ) );
+	}
+	m_numTierRemaining = m_numTierMarbles;
+}
+
+template< typename RandomEngineType >
+void TieredMarbleBag< RandomEngineType >::ResetItems( int tier )
+{
+	std::uint64_t* words = m_nodes.data() + GetTierField( tier, FirstItemWord );
+	std::fill( words, words + detail::GetNumWords( static_cast< int >( GetTierField( tier, ItemCount ) ) ), 0 );
+	SetTierField( tier, ItemsRemoved, 0 );
+}
+
+template< typename RandomEngineType >
+int TieredMarbleBag< RandomEngineType >::DrawItem( int tier )
+{
+	int numItems = static_cast< int >( GetTierField( tier, ItemCount ) );
+	if( GetRemainingItemCount( tier ) == 0 )
+	{
+		if( itemResetPolicy == TierResetPolicy::Never || numItems == 0 )
+		{
+			return -1;
+		}
+		ResetItems( tier );
+	}
+	std::uniform_int_distribution< int > distribution( 0, GetRemainingItemCount( tier ) - 1 );
+	std::uint64_t* words = m_nodes.data() + GetTierField( tier, FirstItemWord );
+	int item = detail::SelectClearBit( words, numItems, 0, distribution( m_randomEngine ) );
+	words[ item / detail::BitsPerWord ] |= std::uint64_t( 1 ) << ( item % detail::BitsPerWord );
+	SetTierField( tier, ItemsRemoved, GetTierField( tier, ItemsRemoved ) + 1 );
+	return item;
+}
+
+template< typename RandomEngineType >
+bool TieredMarbleBag< RandomEngineType >::IsConsistent() const
+{
+	// Records must be in range, bitmaps laid out back to back after the records, and removed counts must match the bits.
+	// Tier totals are summed in 64 bits, they must fit the int counters of the bag.
+	std::uint64_t nextWord = static_cast< std::uint64_t >( m_numTiers ) * TierRecordWords;
+	std::uint64_t totalMarbles = 0;
+	for( int tier = 0; tier < m_numTiers; ++tier )
+	{
+		std::uint32_t numItems = GetTierField( tier, ItemCount );
+		if( GetTierField( tier, TierRemaining ) > GetTierField( tier, TierMarbles ) || GetTierField( tier, TierMarbles ) > 0x7fffffff
+			|| numItems > 0x7fffffff || GetTierField( tier, ItemsRemoved ) > numItems || GetTierField( tier, FirstItemWord ) != nextWord )
+		{
+			return false;
+		}
+		totalMarbles += GetTierField( tier, TierMarbles );
+		if( totalMarbles > 0x7fffffff )
+		{
+			return false;
+		}
+		int numWords = detail::GetNumWords( static_cast< int >( numItems ) );
+		if( nextWord + numWords > m_nodes.size() )
+		{
+			return false;
+		}
+		int numRemoved = 0;
+		for( int i = 0; i < numWords; ++i )
+		{
+			std::uint64_t word = m_nodes[ nextWord + i ];
+			if( i + 1 == numWords && ( word & ~detail::GetLastWordMask( static_cast< int >( numItems ) ) ) != 0 )
+			{
+				return false;
+			}
+			numRemoved += detail::PopCount( word );
+		}
+		if( static_cast< std::uint32_t >( numRemoved ) != GetTierField( tier, ItemsRemoved ) )
+		{
+			return false;
+		}
+		nextWord += numWords;
+	}
+	return nextWord == m_nodes.size();
+}
+
+template< typename RandomEngineType >
+bool TieredMarbleBag< RandomEngineType >::AreCountsValid( const int* tierCounts, const int* itemCounts, int numTiers )
+{
+	// Counts must be non-negative, the marble total must fit an int and every bitmap must start at a 32-bit word index.
+	std::uint64_t totalMarbles = 0;
+	std::uint64_t numWords = static_cast< std::uint64_t >( numTiers > 0 ? numTiers : 0 ) * TierRecordWords;
+	for( int tier = 0; tier < numTiers; ++tier )
+	{
+		if( tierCounts[ tier ] < 0 || itemCounts[ tier ] < 0 )
+		{
+			return false;
+		}
+		totalMarbles += static_cast< std::uint64_t >( tierCounts[ tier ] );
+		numWords += static_cast< std::uint64_t >( detail::GetNumWords( itemCounts[ tier ] ) );
+		if( totalMarbles > 0x7fffffff || numWords > 0x7fffffff )
+		{
+			return false;
+		}
+	}
+	return numTiers >= 0;
+}
+
+}
@@ -0,0 +1,255 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* DropRateSimulator.cpp
+* Parallel Monte Carlo simulation of player sessions rolling a MarbleBag loot table.
+*
+* A table of --n marbles drops the tracked item on any of its first --hits values. Each session
+* starts a fresh bag and rolls --rolls times. Its SplitMix64 engine takes the full 64-bit DeriveSeed( --seed, sessionIndex ),
+* so sessions get distinct streams and results are identical for any thread count. Sessions are spread with the work-stealing
+* ParallelFor(); every chunk of sessions fills private histograms that are merged with
+* atomic adds. Reports time-to-first-drop and drought-length (rolls between consecutive drops)
+* distributions and, for comparison, the same figures for independent rolls at hits / n.
+*
+* Build:
+*	g++ -O2 -std=c++14 -pthread -I.. DropRateSimulator.cpp -o DropRateSimulator
+*
+* Usage:
+*	DropRateSimulator [--n N] [--hits K] [--rolls R] [--sessions S] [--threads T] [--seed S]
+*
+*/
+
+#include "../DynamicMarbleBag.h"
+#include "../MarbleBagParallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+struct Options
+{
+	int numMarbles = { 100 };
+	int numHits = { 5 };
+	int numRolls = { 200 };
+	std::uint64_t numSessions = { 10000000 };
+	unsigned numThreads = { crux::GetDefaultThreadCount() };
+	std::uint64_t seed = { 2017 };
+};
+
+/// Histogram over [0, numRolls], the last bucket also counting sessions without any drop.
+class SharedHistogram
+{
+public:
+
+	explicit SharedHistogram( int numBuckets )
+		: m_counts( new std::atomic< std::uint64_t >[ numBuckets ] )
+		, m_numBuckets( numBuckets )
+	{
+		for( int i = 0; i < numBuckets; ++i )
+		{
+			m_counts[ i ].store( 0, std::memory_order_relaxed );
+		}
+	}
+
+	void Merge( const std::vector< std::uint64_t >& local )
+	{
+		for( int i = 0; i < m_numBuckets; ++i )
+		{
+			if( local[ i ] != 0 )
+			{
+				m_counts[ i ].fetch_add( local[ i ], std::memory_order_relaxed );
+			}
+		}
+	}
+
+	std::uint64_t Get( int bucket ) const { return m_counts[ bucket ].load( std::memory_order_relaxed ); }
+	int GetNumBuckets() const { return m_numBuckets; }
+
+private:
+
+	std::unique_ptr< std::atomic< std::uint64_t >[] > m_counts;
+	int m_numBuckets;
+};
+
+struct Results
+{
+	explicit Results( int numBuckets ) : firstDrop( numBuckets ), drought( numBuckets ) {}
+
+	SharedHistogram firstDrop;		// Rolls until the first drop, 1 based. Bucket numRolls + 1 is "never"
+	SharedHistogram drought;		// Rolls between consecutive drops within a session
+};
+
+template< typename RollType >
+void SimulateSessions( const Options& options, std::uint64_t begin, std::uint64_t end, Results& results, RollType&& rollSession )
+{
+	std::vector< std::uint64_t > firstDrop( options.numRolls + 2, 0 );
+	std::vector< std::uint64_t > drought( options.numRolls + 2, 0 );
+	for( std::uint64_t session = begin; session < end; ++session )
+	{
+		int firstDropRoll = options.numRolls + 1;
+		int lastDropRoll = 0;
+		rollSession( session, [ & ]( int roll )
+		{
+			if( lastDropRoll == 0 )
+			{
+				firstDropRoll = roll;
+			}
+			else
+			{
+				++drought[ roll - lastDropRoll - 1 ];
+			}
+			lastDropRoll = roll;
+		} );
+		++firstDrop[ firstDropRoll ];
+	}
+	results.firstDrop.Merge( firstDrop );
+	results.drought.Merge( drought );
+}
+
+void PrintDistribution( const char* name, const SharedHistogram& histogram, int neverBucket )
+{
+	std::uint64_t total = 0;
+	double sum = 0.0;
+	int maxBucket = 0;
+	for( int i = 0; i < histogram.GetNumBuckets(); ++i )
+	{
+		total += histogram.Get( i );
+		if( i != neverBucket && histogram.Get( i ) != 0 )
+		{
+			sum += static_cast< double >( i ) * static_cast< double >( histogram.Get( i ) );
+			maxBucket = i;
+		}
+	}
+	if( total == 0 )
+	{
+		std::printf( "  %-24s no samples\n", name );
+		return;
+	}
+	const double fractions[] = { 0.5, 0.9, 0.99, 0.999 };
+	int percentiles[ 4 ] = {};
+	for( int p = 0; p < 4; ++p )
+	{
+		std::uint64_t target = static_cast< std::uint64_t >( fractions[ p ] * static_cast< double >( total ) );
+		std::uint64_t seen = 0;
+		percentiles[ p ] = -1;
+		for( int i = 0; i < histogram.GetNumBuckets() && percentiles[ p ] < 0; ++i )
+		{
+			seen += histogram.Get( i );
+			percentiles[ p ] = seen > target ? i : -1;
+		}
+	}
+	std::uint64_t never = neverBucket >= 0 ? histogram.Get( neverBucket ) : 0;
+	std::printf( "  %-24s samples %12llu  mean %8.2f  p50 %5d  p90 %5d  p99 %5d  p99.9 %5d  max %5d  never %.4f%%\n",
+		name, static_cast< unsigned long long >( total ),
+		total > never ? sum / static_cast< double >( total - never ) : 0.0,
+		percentiles[ 0 ], percentiles[ 1 ], percentiles[ 2 ], percentiles[ 3 ], maxBucket,
+		100.0 * static_cast< double >( never ) / static_cast< double >( total ) );
+}
+
+bool ParseArgs( int argc, char** argv, Options& options )
+{
+	for( int i = 1; i + 1 < argc; i += 2 )
+	{
+		const char* value = argv[ i + 1 ];
+		if( std::strcmp( argv[ i ], "--n" ) == 0 )				{ options.numMarbles = std::atoi( value ); }
+		else if( std::strcmp( argv[ i ], "--hits" ) == 0 )		{ options.numHits = std::atoi( value ); }
+		else if( std::strcmp( argv[ i ], "--rolls" ) == 0 )		{ options.numRolls = std::atoi( value ); }
+		else if( std::strcmp( argv[ i ], "--sessions" ) == 0 )	{ options.numSessions = std::strtoull( value, nullptr, 10 ); }
+		else if( std::strcmp( argv[ i ], "--threads" ) == 0 )	{ options.numThreads = static_cast< unsigned >( std::strtoul( value, nullptr, 10 ) ); }
+		else if( std::strcmp( argv[ i ], "--seed" ) == 0 )		{ options.seed = std::strtoull( value, nullptr, 10 ); }
+		else
+		{
+			return false;
+		}
+	}
+	return argc % 2 == 1 && options.numMarbles > 0 && options.numHits > 0 && options.numHits <= options.numMarbles
+		&& options.numRolls > 0 && options.numThreads > 0;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+	Options options;
+	if( !ParseArgs( argc, argv, options ) )
+	{
+		std::fprintf( stderr, "Usage: %s [--n N] [--hits K] [--rolls R] [--sessions S] [--threads T] [--seed S]\n", argv[ 0 ] );
+		return 2;
+	}
+
+	const int numBuckets = options.numRolls + 2;
+	const std::uint64_t grainSize = 1024;
+	Results bagResults( numBuckets );
+	Results independentResults( numBuckets );
+
+	auto start = std::chrono::steady_clock::now();
+	crux::ParallelFor( options.numSessions, options.numThreads, grainSize, [ & ]( std::uint64_t begin, std::uint64_t end, unsigned )
+	{
+		SimulateSessions( options, begin, end, bagResults, [ & ]( std::uint64_t session, auto&& onDrop )
+		{
+			crux::DynamicMarbleBag< crux::SplitMix64 > bag( options.numMarbles, crux::SplitMix64{ crux::DeriveSeed( options.seed, session ) } );
+			for( int roll = 1; roll <= options.numRolls; ++roll )
+			{
+				if( bag.GetNext() < options.numHits )
+				{
+					onDrop( roll );
+				}
+			}
+		} );
+	} );
+	double bagSeconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+	crux::ParallelFor( options.numSessions, options.numThreads, grainSize, [ & ]( std::uint64_t begin, std::uint64_t end, unsigned )
+	{
+		SimulateSessions( options, begin, end, independentResults, [ & ]( std::uint64_t session, auto&& onDrop )
+		{
+			crux::SplitMix64 engine( crux::DeriveSeed( options.seed ^ 0x5bd1e995ull, session ) );
+			std::uniform_int_distribution< int > distribution( 0, options.numMarbles - 1 );
+			for( int roll = 1; roll <= options.numRolls; ++roll )
+			{
+				if( distribution( engine ) < options.numHits )
+				{
+					onDrop( roll );
+				}
+			}
+		} );
+	} );
+
+	double rollsPerSecond = bagSeconds > 0.0 ? static_cast< double >( options.numSessions ) * options.numRolls / bagSeconds : 0.0;
+	std::printf( "table %d/%d, %d rolls per session, %llu sessions, %u threads, %.2fs (%.0f rolls/sec)\n",
+		options.numHits, options.numMarbles, options.numRolls,
+		static_cast< unsigned long long >( options.numSessions ), options.numThreads, bagSeconds, rollsPerSecond );
+	std::printf( "MarbleBag\n" );
+	PrintDistribution( "time to first drop", bagResults.firstDrop, options.numRolls + 1 );
+	PrintDistribution( "drought length", bagResults.drought, -1 );
+	std::printf( "Independent rolls\n" );
+	PrintDistribution( "time to first drop", independentResults.firstDrop, options.numRolls + 1 );
+	PrintDistribution( "drought length", independentResults.drought, -1 );
+	return 0;
+}
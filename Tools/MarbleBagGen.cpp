@@ -0,0 +1,250 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* MarbleBagGen.cpp
+* Command line generator streaming MarbleBag draws to stdout or files.
+*
+* Draws come from DynamicMarbleBag's batch GetNext() in blocks of 64K values and are written with
+* 1 MiB buffered writes. A single stream seeds the engine with --seed directly, so its output equals
+* MarbleBag< N >( Engine{ seed } ). With --streams K > 1, stream i is seeded from seed_seq{ seed, i },
+* written to <output>.<i>, and streams are generated in parallel on --threads threads.
+*
+* Build:
+*	g++ -O2 -std=c++14 -pthread -I.. MarbleBagGen.cpp -o MarbleBagGen
+*
+* Usage:
+*	MarbleBagGen --n N --count C [--seed S] [--engine minstd_rand0|minstd_rand|mt19937|mt19937_64]
+*	             [--format text|u16|u32] [--output PATH|-] [--streams K] [--threads T]
+*	Binary formats are little-endian. u16 requires N <= 65536.
+*
+*/
+
+#include "../DynamicMarbleBag.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+enum class OutputFormat
+{
+	Text,
+	U16,
+	U32
+};
+
+struct Options
+{
+	int numMarbles = { 0 };
+	unsigned long long count = { 0 };
+	std::uint32_t seed = { 2017 };
+	std::string engine = { "minstd_rand0" };
+	OutputFormat format = { OutputFormat::Text };
+	std::string output = { "-" };
+	int numStreams = { 1 };
+	unsigned numThreads = { std::max( 1u, std::thread::hardware_concurrency() ) };
+};
+
+const int BlockSize = 1 << 16;
+const std::size_t WriteBufferSize = 1 << 20;
+
+/// Appends values in the requested format. Returns bytes written to bytes.
+std::size_t Encode( const int* values, int numValues, OutputFormat format, char* bytes )
+{
+	char* cursor = bytes;
+	for( int i = 0; i < numValues; ++i )
+	{
+		std::uint32_t value = static_cast< std::uint32_t >( values[ i ] );
+		switch( format )
+		{
+		case OutputFormat::U16:
+			*cursor++ = static_cast< char >( value & 0xff );
+			*cursor++ = static_cast< char >( ( value >> 8 ) & 0xff );
+			break;
+		case OutputFormat::U32:
+			*cursor++ = static_cast< char >( value & 0xff );
+			*cursor++ = static_cast< char >( ( value >> 8 ) & 0xff );
+			*cursor++ = static_cast< char >( ( value >> 16 ) & 0xff );
+			*cursor++ = static_cast< char >( ( value >> 24 ) & 0xff );
+			break;
+		default:
+			{
+				char digits[ 10 ];
+				int numDigits = 0;
+				do
+				{
+					digits[ numDigits++ ] = static_cast< char >( '0' + value % 10 );
+					value /= 10;
+				} while( value != 0 );
+				while( numDigits > 0 )
+				{
+					*cursor++ = digits[ --numDigits ];
+				}
+				*cursor++ = '\n';
+			}
+			break;
+		}
+	}
+	return static_cast< std::size_t >( cursor - bytes );
+}
+
+template< typename RandomEngineType >
+bool GenerateStream( const Options& options, RandomEngineType&& engine, std::FILE* file )
+{
+	crux::DynamicMarbleBag< RandomEngineType > bag( options.numMarbles, std::forward< RandomEngineType >( engine ) );
+	std::vector< int > values( BlockSize );
+	std::vector< char > bytes( static_cast< std::size_t >( BlockSize ) * 11 );
+	bool bWritten = true;
+	for( unsigned long long remaining = options.count; remaining > 0 && bWritten; )
+	{
+		int numValues = static_cast< int >( remaining < static_cast< unsigned long long >( BlockSize ) ? remaining : BlockSize );
+		bag.GetNext( values.data(), numValues );
+		std::size_t numBytes = Encode( values.data(), numValues, options.format, bytes.data() );
+		bWritten = std::fwrite( bytes.data(), 1, numBytes, file ) == numBytes;
+		remaining -= static_cast< unsigned long long >( numValues );
+	}
+	return std::fflush( file ) == 0 && bWritten;
+}
+
+template< typename RandomEngineType >
+bool GenerateStream( const Options& options, int streamIndex, std::FILE* file )
+{
+	if( options.numStreams == 1 )
+	{
+		return GenerateStream( options, RandomEngineType{ static_cast< typename RandomEngineType::result_type >( options.seed ) }, file );
+	}
+	std::seed_seq sequence{ options.seed, static_cast< std::uint32_t >( streamIndex ) };
+	return GenerateStream( options, RandomEngineType{ sequence }, file );
+}
+
+bool GenerateStream( const Options& options, int streamIndex, std::FILE* file )
+{
+	if( options.engine == "minstd_rand0" )	{ return GenerateStream< std::minstd_rand0 >( options, streamIndex, file ); }
+	if( options.engine == "minstd_rand" )	{ return GenerateStream< std::minstd_rand >( options, streamIndex, file ); }
+	if( options.engine == "mt19937" )		{ return GenerateStream< std::mt19937 >( options, streamIndex, file ); }
+	return GenerateStream< std::mt19937_64 >( options, streamIndex, file );
+}
+
+bool GenerateToPath( const Options& options, int streamIndex, const std::string& path )
+{
+	// setvbuf() must come before any I/O on the stream, and the buffer must outlive it: static for stdout, closed before return otherwise.
+	if( path == "-" )
+	{
+		static char stdoutBuffer[ WriteBufferSize ];
+		std::setvbuf( stdout, stdoutBuffer, _IOFBF, sizeof( stdoutBuffer ) );
+		return GenerateStream( options, streamIndex, stdout );
+	}
+	std::FILE* file = std::fopen( path.c_str(), options.format == OutputFormat::Text ? "w" : "wb" );
+	if( file == nullptr )
+	{
+		std::fprintf( stderr, "Cannot open %s\n", path.c_str() );
+		return false;
+	}
+	std::vector< char > writeBuffer( WriteBufferSize );
+	std::setvbuf( file, writeBuffer.data(), _IOFBF, writeBuffer.size() );
+	bool bWritten = GenerateStream( options, streamIndex, file );
+	return std::fclose( file ) == 0 && bWritten;
+}
+
+bool ParseArgs( int argc, char** argv, Options& options )
+{
+	for( int i = 1; i + 1 < argc; i += 2 )
+	{
+		const char* name = argv[ i ];
+		const char* value = argv[ i + 1 ];
+		if( std::strcmp( name, "--n" ) == 0 )				{ options.numMarbles = std::atoi( value ); }
+		else if( std::strcmp( name, "--count" ) == 0 )		{ options.count = std::strtoull( value, nullptr, 10 ); }
+		else if( std::strcmp( name, "--seed" ) == 0 )		{ options.seed = static_cast< std::uint32_t >( std::strtoul( value, nullptr, 10 ) ); }
+		else if( std::strcmp( name, "--engine" ) == 0 )		{ options.engine = value; }
+		else if( std::strcmp( name, "--output" ) == 0 )		{ options.output = value; }
+		else if( std::strcmp( name, "--streams" ) == 0 )	{ options.numStreams = std::atoi( value ); }
+		else if( std::strcmp( name, "--threads" ) == 0 )	{ options.numThreads = static_cast< unsigned >( std::strtoul( value, nullptr, 10 ) ); }
+		else if( std::strcmp( name, "--format" ) == 0 )
+		{
+			if( std::strcmp( value, "text" ) == 0 )			{ options.format = OutputFormat::Text; }
+			else if( std::strcmp( value, "u16" ) == 0 )		{ options.format = OutputFormat::U16; }
+			else if( std::strcmp( value, "u32" ) == 0 )		{ options.format = OutputFormat::U32; }
+			else
+			{
+				return false;
+			}
+		}
+		else
+		{
+			return false;
+		}
+	}
+	bool bKnownEngine = options.engine == "minstd_rand0" || options.engine == "minstd_rand" || options.engine == "mt19937" || options.engine == "mt19937_64";
+	bool bFitsFormat = options.format != OutputFormat::U16 || options.numMarbles <= 65536;
+	bool bStreamsHavePaths = options.numStreams == 1 || options.output != "-";
+	return argc % 2 == 1 && options.numMarbles > 0 && bKnownEngine && bFitsFormat && options.numStreams > 0 && options.numThreads > 0 && bStreamsHavePaths;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+	Options options;
+	if( !ParseArgs( argc, argv, options ) )
+	{
+		std::fprintf( stderr,
+			"Usage: %s --n N --count C [--seed S] [--engine minstd_rand0|minstd_rand|mt19937|mt19937_64]\n"
+			"       [--format text|u16|u32] [--output PATH|-] [--streams K] [--threads T]\n"
+			"u16 requires N <= 65536. --streams > 1 requires --output, stream i is written to PATH.i\n", argv[ 0 ] );
+		return 2;
+	}
+
+	if( options.numStreams == 1 )
+	{
+		return GenerateToPath( options, 0, options.output ) ? 0 : 1;
+	}
+
+	std::atomic< int > nextStream = { 0 };
+	std::atomic< bool > bFailed = { false };
+	std::vector< std::thread > workers;
+	unsigned numWorkers = std::min( options.numThreads, static_cast< unsigned >( options.numStreams ) );
+	for( unsigned t = 0; t < numWorkers; ++t )
+	{
+		workers.emplace_back( [ & ]()
+		{
+			for( int stream = nextStream++; stream < options.numStreams; stream = nextStream++ )
+			{
+				if( !GenerateToPath( options, stream, options.output + "." + std::to_string( stream ) ) )
+				{
+					bFailed = true;
+				}
+			}
+		} );
+	}
+	for( std::thread& worker : workers )
+	{
+		worker.join();
+	}
+	return bFailed ? 1 : 0;
+}
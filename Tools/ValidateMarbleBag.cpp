@@ -0,0 +1,483 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* ValidateMarbleBag.cpp
+* Multithreaded statistical validation of bag output per (engine, strategy, N).
+* Strategies are the bag implementations: bitset-scan is MarbleBag, word-popcount is DynamicMarbleBag,
+* keyed-perm walks a KeyedPermutation with a new key from the engine per cycle, as Shuffled() does, and
+* grid-excluded draws the column of an N x 2 GridMarbleBag with one cell per column excluded.
+*
+* Each worker thread drives its own bag, seeded from the master seed, for whole cycles and the
+* per-thread tables are summed afterwards. Every table is tested with Pearson's chi-square:
+*	position x value	each value equally likely at each position of a cycle, statistic scaled by ( N - 1 ) / N
+*						since each cycle fills every row and column once, ( N - 1 )^2 dof
+*	permutation			every one of the N! cycle orders equally likely, N <= 7 only, N! - 1 dof
+*	serial pair			one ordered pair of adjacent draws per cycle, at position cycle % ( N - 1 ), uniform over
+*						a != b, N( N - 1 ) - 1 dof. Pairs within one cycle are dependent, so only one is counted
+*	cycle boundary		( last of cycle, first of next cycle ) uniform over all N^2 pairs, N^2 - 1 dof. Only every
+*						second boundary is counted so that no cycle takes part in two pairs
+* A configuration passes when every p-value is at least --alpha. Exit code is 1 if any configuration fails.
+* A null calibration of PermutationQualityMonitor follows: 2000 short trials of a correct bag must alert
+* at p < 0.01 about 1% of the time and average a chi-square near the reported dof.
+*
+* Build:
+*	g++ -O2 -std=c++14 -pthread -I.. ValidateMarbleBag.cpp -o ValidateMarbleBag
+*
+* Usage:
+*	ValidateMarbleBag [--draws N] [--threads N] [--seed N] [--alpha P]
+*	--draws is the number of GetNext() calls per configuration, rounded down to whole cycles.
+*
+*/
+
+#include "../DynamicMarbleBag.h"
+#include "../GridMarbleBag.h"
+#include "../MarbleBag.h"
+#include "../MarbleBagPermutation.h"
+#include "../MarbleBagQualityMonitor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct Options
+{
+	std::uint64_t numDraws = { 100000000 };
+	unsigned numThreads = { std::max( 1u, std::thread::hardware_concurrency() ) };
+	std::uint32_t seed = { 2017 };
+	double alpha = { 1e-4 };
+};
+
+/// Frequency tables of one worker.
+struct Tables
+{
+	std::vector< std::uint64_t > positionValue;		// [ position * N + value ]
+	std::vector< std::uint64_t > permutations;		// [ Lehmer rank ], empty when N > MaxExhaustiveMarbles
+	std::vector< std::uint64_t > serialPairs;		// [ previous * N + next ] within a cycle
+	std::vector< std::uint64_t > boundaryPairs;		// [ last * N + first ] across consecutive cycles
+	std::uint64_t numCycles = { 0 };
+
+	void Add( const Tables& other )
+	{
+		AddVector( positionValue, other.positionValue );
+		AddVector( permutations, other.permutations );
+		AddVector( serialPairs, other.serialPairs );
+		AddVector( boundaryPairs, other.boundaryPairs );
+		numCycles += other.numCycles;
+	}
+
+	static void AddVector( std::vector< std::uint64_t >& target, const std::vector< std::uint64_t >& source )
+	{
+		for( std::size_t i = 0; i < target.size(); ++i )
+		{
+			target[ i ] += source[ i ];
+		}
+	}
+};
+
+const int MaxExhaustiveMarbles = 7;
+
+std::uint64_t Factorial( int n )
+{
+	std::uint64_t result = 1;
+	for( int i = 2; i <= n; ++i )
+	{
+		result *= static_cast< std::uint64_t >( i );
+	}
+	return result;
+}
+
+/// Returns lexicographic rank of a permutation of [0, numMarbles).
+std::uint64_t PermutationRank( const int* values, int numMarbles )
+{
+	std::uint64_t rank = 0;
+	for( int i = 0; i < numMarbles; ++i )
+	{
+		int smallerAfter = 0;
+		for( int j = i + 1; j < numMarbles; ++j )
+		{
+			smallerAfter += values[ j ] < values[ i ] ? 1 : 0;
+		}
+		rank = rank * static_cast< std::uint64_t >( numMarbles - i ) + static_cast< std::uint64_t >( smallerAfter );
+	}
+	return rank;
+}
+
+/// Chi-square statistic of counts against a uniform expectation over the cells where included( cell ) holds. Writes number of included cells.
+template< typename IncludedType >
+double UniformChiSquare( const std::vector< std::uint64_t >& counts, IncludedType included, std::size_t& outNumCells )
+{
+	std::uint64_t total = 0;
+	outNumCells = 0;
+	for( std::size_t cell = 0; cell < counts.size(); ++cell )
+	{
+		if( included( cell ) )
+		{
+			total += counts[ cell ];
+			++outNumCells;
+		}
+	}
+	if( total == 0 )
+	{
+		return 0.0;
+	}
+	double expected = static_cast< double >( total ) / static_cast< double >( outNumCells );
+	double chiSquare = 0.0;
+	for( std::size_t cell = 0; cell < counts.size(); ++cell )
+	{
+		if( included( cell ) )
+		{
+			double difference = static_cast< double >( counts[ cell ] ) - expected;
+			chiSquare += difference * difference / expected;
+		}
+	}
+	return chiSquare;
+}
+
+/// Chi-square p-value of counts against a uniform expectation over the cells where included( cell ) holds, independent cells.
+template< typename IncludedType >
+double UniformPValue( const std::vector< std::uint64_t >& counts, IncludedType included )
+{
+	std::size_t numCells = 0;
+	double chiSquare = UniformChiSquare( counts, included, numCells );
+	if( numCells < 2 )
+	{
+		return 1.0;
+	}
+	return crux::UpperRegularizedGamma( 0.5 * static_cast< double >( numCells - 1 ), 0.5 * chiSquare );
+}
+
+/// Chi-square p-value of a position x value table of whole cycles, scaled by ( N - 1 ) / N on ( N - 1 )^2 dof like PermutationQualityMonitor.
+double PositionValuePValue( const std::vector< std::uint64_t >& counts, int numMarbles )
+{
+	if( numMarbles < 2 )
+	{
+		return 1.0;
+	}
+	std::size_t numCells = 0;
+	double chiSquare = UniformChiSquare( counts, []( std::size_t ) { return true; }, numCells ) * ( numMarbles - 1 ) / numMarbles;
+	return crux::UpperRegularizedGamma( 0.5 * static_cast< double >( numMarbles - 1 ) * ( numMarbles - 1 ), 0.5 * chiSquare );
+}
+
+/// MarbleBag, index scan over the removed bitset.
+template< int NumMarbles, typename RandomEngineType >
+struct BitsetScanStrategy
+{
+	typedef crux::MarbleBag< NumMarbles, RandomEngineType > BagType;
+	static const char* GetName() { return "bitset-scan"; }
+	static BagType Create( RandomEngineType&& randomEngine ) { return BagType( std::move( randomEngine ) ); }
+};
+
+/// DynamicMarbleBag, popcount selection over 64-bit words.
+template< int NumMarbles, typename RandomEngineType >
+struct WordPopcountStrategy
+{
+	typedef crux::DynamicMarbleBag< RandomEngineType > BagType;
+	static const char* GetName() { return "word-popcount"; }
+	static BagType Create( RandomEngineType&& randomEngine ) { return BagType( NumMarbles, std::move( randomEngine ) ); }
+};
+
+/// Cycles of KeyedPermutation, keyed from the engine at the start of each cycle.
+template< int NumMarbles, typename RandomEngineType >
+class KeyedPermutationBag
+{
+public:
+
+	explicit KeyedPermutationBag( RandomEngineType&& randomEngine ) : m_randomEngine( std::move( randomEngine ) ) {}
+
+	int GetNext()
+	{
+		if( m_position == 0 )
+		{
+			std::uniform_int_distribution< std::uint64_t > distribution;
+			m_permutation = crux::KeyedPermutation( NumMarbles, distribution( m_randomEngine ) );
+		}
+		int value = static_cast< int >( m_permutation( m_position ) );
+		m_position = ( m_position + 1 ) % NumMarbles;
+		return value;
+	}
+
+private:
+
+	RandomEngineType m_randomEngine;
+	crux::KeyedPermutation m_permutation;
+	std::uint64_t m_position = { 0 };
+};
+
+template< int NumMarbles, typename RandomEngineType >
+struct KeyedPermutationStrategy
+{
+	typedef KeyedPermutationBag< NumMarbles, RandomEngineType > BagType;
+	static const char* GetName() { return "keyed-perm"; }
+	static BagType Create( RandomEngineType&& randomEngine ) { return BagType( std::move( randomEngine ) ); }
+};
+
+/// GridMarbleBag over N x 2 cells in 1 x 1 regions with a checkerboard excluded, leaving one cell per column; draws return the column.
+template< int NumMarbles, typename RandomEngineType >
+class ExcludedGridBag
+{
+public:
+
+	explicit ExcludedGridBag( RandomEngineType&& randomEngine )
+		: m_grid( GetExtents(), std::move( randomEngine ) )
+	{
+		const int regionExtents[ 2 ] = { 1, 1 };
+		std::vector< std::uint64_t > excludedWords( crux::detail::GetNumWords( 2 * NumMarbles ), 0 );
+		for( int x = 0; x < NumMarbles; ++x )
+		{
+			int region = x + NumMarbles * ( x % 2 );
+			excludedWords[ region / 64 ] |= std::uint64_t( 1 ) << ( region % 64 );
+		}
+		m_grid.SetExcludedRegions( regionExtents, excludedWords.data() );
+	}
+
+	int GetNext()
+	{
+		int cell[ 2 ];
+		m_grid.GetNext( cell );
+		return cell[ 0 ];
+	}
+
+private:
+
+	static const int* GetExtents()
+	{
+		static const int extents[ 2 ] = { NumMarbles, 2 };
+		return extents;
+	}
+
+	crux::GridMarbleBag< 2, RandomEngineType > m_grid;
+};
+
+template< int NumMarbles, typename RandomEngineType >
+struct ExcludedGridStrategy
+{
+	typedef ExcludedGridBag< NumMarbles, RandomEngineType > BagType;
+	static const char* GetName() { return "grid-excluded"; }
+	static BagType Create( RandomEngineType&& randomEngine ) { return BagType( std::move( randomEngine ) ); }
+};
+
+template< int NumMarbles, typename RandomEngineType, template< int, typename > class StrategyType >
+void RunWorker( std::uint32_t seed, std::uint32_t engineIndex, unsigned threadIndex, std::uint64_t numCycles, Tables& tables )
+{
+	typedef StrategyType< NumMarbles, RandomEngineType > Strategy;
+	std::seed_seq sequence{ seed, engineIndex, static_cast< std::uint32_t >( NumMarbles ), static_cast< std::uint32_t >( threadIndex ) };
+	typename Strategy::BagType bag = Strategy::Create( RandomEngineType{ sequence } );
+
+	int cycle[ NumMarbles ];
+	int previousLast = -1;
+	for( std::uint64_t c = 0; c < numCycles; ++c )
+	{
+		for( int position = 0; position < NumMarbles; ++position )
+		{
+			cycle[ position ] = bag.GetNext();
+		}
+		for( int position = 0; position < NumMarbles; ++position )
+		{
+			++tables.positionValue[ position * NumMarbles + cycle[ position ] ];
+		}
+		if( NumMarbles > 1 )
+		{
+			int position = static_cast< int >( c % ( NumMarbles - 1 ) );
+			++tables.serialPairs[ cycle[ position ] * NumMarbles + cycle[ position + 1 ] ];
+		}
+		if( previousLast >= 0 )
+		{
+			++tables.boundaryPairs[ previousLast * NumMarbles + cycle[ 0 ] ];
+		}
+		previousLast = c % 2 == 0 ? cycle[ NumMarbles - 1 ] : -1;
+		if( !tables.permutations.empty() )
+		{
+			++tables.permutations[ PermutationRank( cycle, NumMarbles ) ];
+		}
+	}
+	tables.numCycles = numCycles;
+}
+
+template< int NumMarbles, typename RandomEngineType, template< int, typename > class StrategyType >
+bool Validate( const char* engineName, std::uint32_t engineIndex, const Options& options )
+{
+	const std::size_t numCells = static_cast< std::size_t >( NumMarbles ) * NumMarbles;
+	const std::size_t numPermutations = NumMarbles <= MaxExhaustiveMarbles ? static_cast< std::size_t >( Factorial( NumMarbles ) ) : 0;
+	std::uint64_t totalCycles = options.numDraws / NumMarbles;
+
+	std::vector< Tables > workerTables( options.numThreads );
+	std::vector< std::thread > workers;
+	for( unsigned t = 0; t < options.numThreads; ++t )
+	{
+		Tables& tables = workerTables[ t ];
+		tables.positionValue.assign( numCells, 0 );
+		tables.permutations.assign( numPermutations, 0 );
+		tables.serialPairs.assign( numCells, 0 );
+		tables.boundaryPairs.assign( numCells, 0 );
+		std::uint64_t numCycles = totalCycles / options.numThreads + ( t < totalCycles % options.numThreads ? 1 : 0 );
+		workers.emplace_back( RunWorker< NumMarbles, RandomEngineType, StrategyType >, options.seed, engineIndex, t, numCycles, std::ref( tables ) );
+	}
+	for( std::thread& worker : workers )
+	{
+		worker.join();
+	}
+	Tables total = std::move( workerTables[ 0 ] );
+	for( unsigned t = 1; t < options.numThreads; ++t )
+	{
+		total.Add( workerTables[ t ] );
+	}
+
+	auto all = []( std::size_t ) { return true; };
+	auto offDiagonal = []( std::size_t cell ) { return cell / NumMarbles != cell % NumMarbles; };
+	double positionValueP = PositionValuePValue( total.positionValue, NumMarbles );
+	double permutationP = numPermutations > 0 ? UniformPValue( total.permutations, all ) : 1.0;
+	double serialP = UniformPValue( total.serialPairs, offDiagonal );
+	double boundaryP = UniformPValue( total.boundaryPairs, all );
+	bool bPassed = positionValueP >= options.alpha && permutationP >= options.alpha && serialP >= options.alpha && boundaryP >= options.alpha;
+
+	char permutationText[ 32 ];
+	if( numPermutations > 0 )
+	{
+		std::snprintf( permutationText, sizeof( permutationText ), "%.4g", permutationP );
+	}
+	else
+	{
+		std::snprintf( permutationText, sizeof( permutationText ), "-" );
+	}
+	std::printf( "%-14s %-13s %6d %14llu %12.4g %12s %12.4g %12.4g  %s\n",
+		engineName, StrategyType< NumMarbles, RandomEngineType >::GetName(), NumMarbles,
+		static_cast< unsigned long long >( total.numCycles ),
+		positionValueP, permutationText, serialP, boundaryP,
+		bPassed ? "PASS" : "FAIL" );
+	std::fflush( stdout );
+	return bPassed;
+}
+
+template< typename RandomEngineType, template< int, typename > class StrategyType >
+bool ValidateSizes( const char* engineName, std::uint32_t engineIndex, const Options& options )
+{
+	bool bPassed = true;
+	bPassed &= Validate< 2, RandomEngineType, StrategyType >( engineName, engineIndex, options );
+	bPassed &= Validate< 3, RandomEngineType, StrategyType >( engineName, engineIndex, options );
+	bPassed &= Validate< 4, RandomEngineType, StrategyType >( engineName, engineIndex, options );
+	bPassed &= Validate< 5, RandomEngineType, StrategyType >( engineName, engineIndex, options );
+	bPassed &= Validate< 7, RandomEngineType, StrategyType >( engineName, engineIndex, options );
+	bPassed &= Validate< 16, RandomEngineType, StrategyType >( engineName, engineIndex, options );
+	bPassed &= Validate< 100, RandomEngineType, StrategyType >( engineName, engineIndex, options );
+	return bPassed;
+}
+
+template< typename RandomEngineType >
+bool ValidateStrategies( const char* engineName, std::uint32_t engineIndex, const Options& options )
+{
+	bool bPassed = true;
+	bPassed &= ValidateSizes< RandomEngineType, BitsetScanStrategy >( engineName, engineIndex, options );
+	bPassed &= ValidateSizes< RandomEngineType, WordPopcountStrategy >( engineName, engineIndex, options );
+	bPassed &= ValidateSizes< RandomEngineType, KeyedPermutationStrategy >( engineName, engineIndex, options );
+	bPassed &= ValidateSizes< RandomEngineType, ExcludedGridStrategy >( engineName, engineIndex, options );
+	return bPassed;
+}
+
+/// Checks PermutationQualityMonitor against a correct bag: false alarm rate at p < 0.01 and mean chi-square against dof, each within 4 standard errors.
+template< int NumMarbles >
+bool CalibrateMonitor( const Options& options )
+{
+	const int numTrials = 2000;
+	const int cyclesPerTrial = 200;
+	const double alarmPValue = 0.01;
+	crux::PermutationQualityMonitor< NumMarbles > monitor( 0.0, cyclesPerTrial + 1 );
+	crux::MarbleBag< NumMarbles, std::mt19937_64 > bag( std::mt19937_64{ options.seed } );
+
+	int cycle[ NumMarbles ];
+	int numAlarms = 0;
+	double sumChiSquare = 0.0;
+	double degreesOfFreedom = 0.0;
+	for( int trial = 0; trial < numTrials; ++trial )
+	{
+		monitor.ResetStatistics();
+		for( int c = 0; c < cyclesPerTrial; ++c )
+		{
+			for( int position = 0; position < NumMarbles; ++position )
+			{
+				cycle[ position ] = bag.GetNext();
+			}
+			monitor.AddCycle( cycle );
+		}
+		crux::PermutationQualityReport report = monitor.Evaluate();
+		numAlarms += report.pValue < alarmPValue ? 1 : 0;
+		sumChiSquare += report.chiSquare;
+		degreesOfFreedom = report.degreesOfFreedom;
+	}
+	double alarmRate = static_cast< double >( numAlarms ) / numTrials;
+	double meanChiSquare = sumChiSquare / numTrials;
+	bool bPassed = std::fabs( alarmRate - alarmPValue ) <= 4.0 * std::sqrt( alarmPValue * ( 1.0 - alarmPValue ) / numTrials )
+		&& std::fabs( meanChiSquare - degreesOfFreedom ) <= 4.0 * std::sqrt( 2.0 * degreesOfFreedom / numTrials );
+	std::printf( "%-14s %6d %8d %14.4f %12.2f %8.0f  %s\n", "monitor-null", NumMarbles, numTrials, alarmRate, meanChiSquare, degreesOfFreedom, bPassed ? "PASS" : "FAIL" );
+	std::fflush( stdout );
+	return bPassed;
+}
+
+bool ParseArgs( int argc, char** argv, Options& options )
+{
+	for( int i = 1; i + 1 < argc; i += 2 )
+	{
+		if( std::strcmp( argv[ i ], "--draws" ) == 0 )			{ options.numDraws = std::strtoull( argv[ i + 1 ], nullptr, 10 ); }
+		else if( std::strcmp( argv[ i ], "--threads" ) == 0 )	{ options.numThreads = static_cast< unsigned >( std::strtoul( argv[ i + 1 ], nullptr, 10 ) ); }
+		else if( std::strcmp( argv[ i ], "--seed" ) == 0 )		{ options.seed = static_cast< std::uint32_t >( std::strtoul( argv[ i + 1 ], nullptr, 10 ) ); }
+		else if( std::strcmp( argv[ i ], "--alpha" ) == 0 )		{ options.alpha = std::strtod( argv[ i + 1 ], nullptr ); }
+		else
+		{
+			return false;
+		}
+	}
+	return argc % 2 == 1 && options.numThreads > 0 && options.numDraws > 0;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+	Options options;
+	if( !ParseArgs( argc, argv, options ) )
+	{
+		std::fprintf( stderr, "Usage: %s [--draws N] [--threads N] [--seed N] [--alpha P]\n", argv[ 0 ] );
+		return 2;
+	}
+
+	std::printf( "%-14s %-13s %6s %14s %12s %12s %12s %12s  %s\n", "engine", "strategy", "N", "cycles", "p(pos*val)", "p(perm)", "p(serial)", "p(boundary)", "result" );
+	bool bPassed = true;
+	bPassed &= ValidateStrategies< std::minstd_rand0 >( "minstd_rand0", 0, options );
+	bPassed &= ValidateStrategies< std::minstd_rand >( "minstd_rand", 1, options );
+	bPassed &= ValidateStrategies< std::mt19937 >( "mt19937", 2, options );
+	bPassed &= ValidateStrategies< std::mt19937_64 >( "mt19937_64", 3, options );
+	bPassed &= ValidateStrategies< std::ranlux24 >( "ranlux24", 4, options );
+
+	std::printf( "\n%-14s %6s %8s %14s %12s %8s  %s\n", "check", "N", "trials", "alarms@0.01", "mean chi2", "dof", "result" );
+	bPassed &= CalibrateMonitor< 2 >( options );
+	bPassed &= CalibrateMonitor< 4 >( options );
+	bPassed &= CalibrateMonitor< 10 >( options );
+	std::printf( "%s\n", bPassed ? "ALL PASS" : "FAILURES" );
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,339 @@
+/**
+* Copyright (c) 2017 Andrew Nguyen, http://www.github.com/ravenwing1234
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+* WeightedMarbleBag.h
+* Dependent probability over categories holding several marbles each.
+* State is the marbles remaining per category instead of a bit per marble, so a table of a few
+* categories stays a few integers however long its cycle is. GetNext() rolls once and walks the
+* remaining counts. FastForward() resolves many draws at once from whole cycles plus a multivariate
+* hypergeometric sample of the partial cycle, in time independent of the number of draws.
+* Counts usually come from CompileProbabilityTable(), see ProbabilityTable.h.
+* Move constructor and move assignment only, no copy.
+*
+* Usage:
+*	WeightedMarbleBag<> bag( table );												// Any table with GetCounts() and GetNumCategories(), chrono-based seed
+*	WeightedMarbleBag<> bag( counts, 3, std::move( std::default_random_engine{ 2017 } ) );	// Raw counts with explicit seed
+*	int category = bag.GetNext();													// Next category
+*	std::int64_t numDrawn = bag.FastForward( 20000, categoryCounts );				// Counts per category of the next 20000 draws
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace crux
+{
+namespace detail
+{
+/// Returns successes among numDraws draws without replacement from populationSize marbles holding numSuccesses successes.
+/// Simulates the smaller of the drawn and undrawn sides, so takes at most populationSize / 2 rolls.
+template< typename RandomEngineType >
+int SampleHypergeometric( RandomEngineType& randomEngine, int numDraws, int numSuccesses, int populationSize )
+{
+	bool bSampleUndrawn = numDraws * 2 > populationSize;
+	int numTrials = bSampleUndrawn ? populationSize - numDraws : numDraws;
+	int successesLeft = numSuccesses;
+	int populationLeft = populationSize;
+	int numHits = 0;
+	for( int trial = 0; trial < numTrials && successesLeft > 0; ++trial )
+	{
+		if( successesLeft == populationLeft )
+		{
+			numHits += numTrials - trial;
+			break;
+		}
+		std::uniform_int_distribution< int > distribution( 0, populationLeft - 1 );
+		if( distribution( randomEngine ) < successesLeft )
+		{
+			++numHits;
+			--successesLeft;
+		}
+		--populationLeft;
+	}
+	return bSampleUndrawn ? numSuccesses - numHits : numHits;
+}
+}
+
+/// Utility for dependent probability of weighted categories.
+template< typename RandomEngineType = std::default_random_engine >
+class WeightedMarbleBag
+{
+public:
+
+	/// Constructor with chrono-based seed
+	WeightedMarbleBag( const int* counts, int numCategories );
+
+	/// Constructor with move of random engine type
+	WeightedMarbleBag( const int* counts, int numCategories, RandomEngineType&& randomEngine );
+
+	/// Constructors from a table exposing GetCounts() and GetNumCategories()
+	template< typename TableType >
+	explicit WeightedMarbleBag( const TableType& table );
+	template< typename TableType >
+	WeightedMarbleBag( const TableType& table, RandomEngineType&& randomEngine );
+
+	/// Destructor
+	~WeightedMarbleBag() = default;
+
+	/// No copy operations
+	WeightedMarbleBag( const WeightedMarbleBag< RandomEngineType >& other ) = delete;
+	WeightedMarbleBag& operator=( const WeightedMarbleBag< RandomEngineType >& other ) = delete;
+
+	/// Move operations
+	WeightedMarbleBag( WeightedMarbleBag< RandomEngineType >&& other ) = default;
+	WeightedMarbleBag& operator=( WeightedMarbleBag< RandomEngineType >&& other ) = default;
+
+	/// Returns category of next marble. Returns -1 if no marbles remain. Use Reset() to restore marbles.
+	const int GetNext();
+
+	/// Writes up to count next categories. Returns number written, less than count only if marbles ran out without bAutoReset.
+	int GetNext( int* outCategories, int count );
+
+	/// Advances as if GetNext() were called numDraws times, writing how often each category was drawn to outCategoryCounts[ GetNumCategories() ].
+	/// Returns draws taken, less than numDraws only if marbles ran out without bAutoReset.
+	std::int64_t FastForward( std::int64_t numDraws, std::int64_t* outCategoryCounts );
+
+	/// Returns quantity of marbles that still exist.
+	const int GetRemainingCount() const;
+
+	/// Returns quantity of marbles of a category that still exist.
+	const int GetRemainingCount( int category ) const;
+
+	/// Returns total quantity of marbles.
+	const int GetNumMarbles() const;
+
+	/// Returns quantity of categories.
+	const int GetNumCategories() const;
+
+	/// Returns if any marbles remain.
+	bool HasMarbles() const;
+
+	/// Returns all marbles to bag.
+	void Reset();
+
+	/// Explicitly set random engine.
+	void SetRandomEngine( RandomEngineType&& randomEngine );
+
+private:
+
+	void RemoveRandomSample( int numToRemove, std::int64_t* outCategoryCounts );
+
+private:
+
+	RandomEngineType m_randomEngine;
+	std::vector< int > m_counts;
+	std::vector< int > m_remainingCounts;
+	int m_numMarbles = { 0 };
+	int m_numRemaining = { 0 };
+
+public:
+
+	/// If true, auto reset marble bag when empty
+	bool bAutoReset = { true };
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// Implementation
+//////////////////////////////////////////////////////////////////////////
+
+//
+// Public
+//
+
+template< typename RandomEngineType >
+void WeightedMarbleBag< RandomEngineType >::SetRandomEngine( RandomEngineType&& randomEngine )
+{
+	m_randomEngine = std::forward< RandomEngineType >( randomEngine );
+}
+
+template< typename RandomEngineType >
+void WeightedMarbleBag< RandomEngineType >::Reset()
+{
+	m_remainingCounts = m_counts;
+	m_numRemaining = m_numMarbles;
+}
+
+template< typename RandomEngineType >
+bool WeightedMarbleBag< RandomEngineType >::HasMarbles() const
+{
+	return m_numRemaining > 0;
+}
+
+template< typename RandomEngineType >
+const int WeightedMarbleBag< RandomEngineType >::GetNumCategories() const
+{
+	return static_cast< int >( m_counts.size() );
+}
+
+template< typename RandomEngineType >
+const int WeightedMarbleBag< RandomEngineType >::GetNumMarbles() const
+{
+	return m_numMarbles;
+}
+
+template< typename RandomEngineType >
+const int WeightedMarbleBag< RandomEngineType >::GetRemainingCount( int category ) const
+{
+	return m_remainingCounts[ category ];
+}
+
+template< typename RandomEngineType >
+const int WeightedMarbleBag< RandomEngineType >::GetRemainingCount() const
+{
+	return m_numRemaining;
+}
+
+template< typename RandomEngineType >
+const int WeightedMarbleBag< RandomEngineType >::GetNext()
+{
+	if( !HasMarbles() )
+	{
+		if( bAutoReset && m_numMarbles > 0 )
+		{
+			Reset();
+		}
+		else
+		{
+			return -1;
+		}
+	}
+	std::uniform_int_distribution< int > distribution( 0, m_numRemaining - 1 );
+	int roll = distribution( m_randomEngine );
+	int category = 0;
+	while( roll >= m_remainingCounts[ category ] )
+	{
+		roll -= m_remainingCounts[ category ];
+		++category;
+	}
+	--m_remainingCounts[ category ];
+	--m_numRemaining;
+	return category;
+}
+
+template< typename RandomEngineType >
+int WeightedMarbleBag< RandomEngineType >::GetNext( int* outCategories, int count )
+{
+	for( int i = 0; i < count; ++i )
+	{
+		int category = GetNext();
+		if( category < 0 )
+		{
+			return i;
+		}
+		outCategories[ i ] = category;
+	}
+	return count;
+}
+
+template< typename RandomEngineType >
+std::int64_t WeightedMarbleBag< RandomEngineType >::FastForward( std::int64_t numDraws, std::int64_t* outCategoryCounts )
+{
+	std::fill( outCategoryCounts, outCategoryCounts + GetNumCategories(), 0 );
+	if( numDraws <= 0 || m_numMarbles == 0 )
+	{
+		return 0;
+	}
+	int numRemaining = m_numRemaining;
+	if( numDraws <= numRemaining )
+	{
+		RemoveRandomSample( static_cast< int >( numDraws ), outCategoryCounts );
+		return numDraws;
+	}
+
+	// Everything left in this cycle is drawn, then whole cycles draw every category's full count.
+	std::copy( m_remainingCounts.begin(), m_remainingCounts.end(), outCategoryCounts );
+	std::fill( m_remainingCounts.begin(), m_remainingCounts.end(), 0 );
+	m_numRemaining = 0;
+	if( !bAutoReset )
+	{
+		return numRemaining;
+	}
+	std::int64_t numCycles = ( numDraws - numRemaining ) / m_numMarbles;
+	int numPartial = static_cast< int >( ( numDraws - numRemaining ) % m_numMarbles );
+	for( int i = 0; i < GetNumCategories(); ++i )
+	{
+		outCategoryCounts[ i ] += numCycles * m_counts[ i ];
+	}
+	if( numPartial > 0 )
+	{
+		Reset();
+		RemoveRandomSample( numPartial, outCategoryCounts );
+	}
+	return numDraws;
+}
+
+template< typename RandomEngineType >
+WeightedMarbleBag< RandomEngineType >::WeightedMarbleBag( const int* counts, int numCategories, RandomEngineType&& randomEngine )
+	: m_randomEngine( std::forward< RandomEngineType >( randomEngine ) )
+	, m_counts( counts, counts + numCategories )
+{
+	for( int count : m_counts )
+	{
+		m_numMarbles += count;
+	}
+	Reset();
+}
+
+template< typename RandomEngineType >
+WeightedMarbleBag< RandomEngineType >::WeightedMarbleBag( const int* counts, int numCategories )
+	: WeightedMarbleBag( counts, numCategories, std::move( RandomEngineType{ static_cast< typename RandomEngineType::result_type >( std::chrono::system_clock::now().time_since_epoch().count() ) } ) )
+{}
+
+template< typename RandomEngineType >
+template< typename TableType >
+WeightedMarbleBag< RandomEngineType >::WeightedMarbleBag( const TableType& table, RandomEngineType&& randomEngine )
+	: WeightedMarbleBag( table.GetCounts(), table.GetNumCategories(), std::forward< RandomEngineType >( randomEngine ) )
+{}
+
+template< typename RandomEngineType >
+template< typename TableType >
+WeightedMarbleBag< RandomEngineType >::WeightedMarbleBag( const TableType& table )
+	: WeightedMarbleBag( table.GetCounts(), table.GetNumCategories() )
+{}
+
+//
+// Private
+//
+
+template< typename RandomEngineType >
+void WeightedMarbleBag< RandomEngineType >::RemoveRandomSample( int numToRemove, std::int64_t* outCategoryCounts )
+{
+	// Multivariate hypergeometric as a chain of univariate ones: each category's share of the draws
+	// left, against the marbles of the categories not yet visited.
+	int drawsLeft = numToRemove;
+	int populationLeft = m_numRemaining;
+	for( int i = 0; i < GetNumCategories() && drawsLeft > 0; ++i )
+	{
+		int numTaken = detail::SampleHypergeometric( m_randomEngine, drawsLeft, m_remainingCounts[ i ], populationLeft );
+		populationLeft -= m_remainingCounts[ i ];
+		m_remainingCounts[ i ] -= numTaken;
+		outCategoryCounts[ i ] += numTaken;
+		drawsLeft -= numTaken;
+	}
+	m_numRemaining -= numToRemove;
+}
+
+}